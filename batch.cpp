@@ -0,0 +1,207 @@
+#include "batch.h"
+#include "binarygen.h"
+#include "compiler.h"
+#include "scheduler.h"
+#include "threadpool.h"
+#include "vm.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <unordered_map>
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static std::string trim(const std::string &text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return "";
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+BatchRunner::BatchRunner(size_t threads) : threads(threads == 0 ? 1 : threads) {}
+
+void BatchRunner::setQuantum(uint64_t instructions)
+{
+    quantum = instructions;
+}
+
+void BatchRunner::setInstructionLimit(uint64_t instructions)
+{
+    instructionLimit = instructions;
+}
+
+void BatchRunner::setOptimizationLevel(int level)
+{
+    optimizationLevel = level;
+}
+
+void BatchRunner::setCache(const CompileCache *compileCache)
+{
+    cache = compileCache;
+}
+
+void BatchRunner::loadJobs(const std::string &jobsFile)
+{
+    std::ifstream in(jobsFile);
+    if (!in)
+        throw std::runtime_error("Could not open jobs file: " + jobsFile);
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+        addJob(line);
+    }
+}
+
+void BatchRunner::addJob(const std::string &sourceFile)
+{
+    size_t index = programs.size();
+    for (size_t i = 0; i < programs.size(); ++i)
+    {
+        if (programs[i].path == sourceFile)
+        {
+            index = i;
+            break;
+        }
+    }
+    if (index == programs.size())
+        programs.push_back({sourceFile, nullptr, "", false});
+
+    Job job;
+    job.program = index;
+    jobs.push_back(job);
+}
+
+size_t BatchRunner::run()
+{
+    // Phase 1: compile each distinct program once
+    Clock::time_point start = Clock::now();
+    {
+        ThreadPool pool(threads);
+        for (Program &program : programs)
+        {
+            pool.submit([&program, level = optimizationLevel, cache = cache]
+                        {
+                try
+                {
+                    if (!hasSBSuffix(program.path))
+                        throw std::runtime_error("Source file must have a .sb extension");
+                    CompileOptions options;
+                    options.optimizationLevel = level;
+                    std::string source = readFile(program.path);
+                    std::string key = CompileCache::key(source, options);
+                    std::vector<uint8_t> bytecode;
+                    if (cache && cache->load(key, source, bytecode))
+                    {
+                        program.image = ProgramImage::fromBinary(bytecode);
+                        program.cached = true;
+                        return;
+                    }
+
+                    InstructionBuffer instructions = compileSource(source, options);
+                    if (cache)
+                        cache->store(key, source, BinaryGenerator().encode(instructions));
+                    program.image = ProgramImage::fromInstructions(instructions);
+                }
+                catch (const std::exception &e)
+                {
+                    program.error = e.what();
+                } });
+        }
+        pool.wait();
+    }
+    compileMs = elapsedMs(start);
+
+    // Phase 2: every job gets its own VM against the shared image
+    start = Clock::now();
+    std::vector<std::unique_ptr<VirtualMachine>> vms(jobs.size());
+    std::vector<MemoryOutputSink> sinks(jobs.size());
+    std::vector<size_t> taskIds(jobs.size());
+    Scheduler scheduler(threads, quantum);
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        const Program &program = programs[jobs[i].program];
+        if (!program.image)
+        {
+            jobs[i].error = program.error;
+            continue;
+        }
+
+        vms[i] = std::make_unique<VirtualMachine>();
+        vms[i]->setOutput(&sinks[i]);
+        vms[i]->load(program.image);
+        taskIds[i] = scheduler.add(vms[i].get(), instructionLimit);
+    }
+    scheduler.run();
+    runMs = elapsedMs(start);
+
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        if (!vms[i])
+            continue;
+        jobs[i].output = sinks[i].contents();
+        jobs[i].instructions = vms[i]->retiredInstructions();
+        jobs[i].error = scheduler.task(taskIds[i]).error;
+    }
+
+    failures = 0;
+    for (const Job &job : jobs)
+    {
+        if (!job.error.empty())
+            ++failures;
+    }
+    return failures;
+}
+
+void BatchRunner::writeOutput(std::ostream &out, std::ostream &err) const
+{
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        const Job &job = jobs[i];
+        out << job.output;
+        if (!job.error.empty())
+            err << "Error: job " << i + 1 << " (" << programs[job.program].path << "): " << job.error << "\n";
+    }
+    out.flush();
+}
+
+void BatchRunner::writeReport(std::ostream &out) const
+{
+    size_t outputBytes = 0;
+    uint64_t instructions = 0;
+    size_t cached = 0;
+    for (const Program &program : programs)
+        cached += program.cached;
+    for (const Job &job : jobs)
+    {
+        outputBytes += job.output.size();
+        instructions += job.instructions;
+    }
+
+    double wallMs = compileMs + runMs;
+    double jobsPerSecond = runMs > 0 ? jobs.size() * 1000.0 / runMs : 0.0;
+
+    out << std::fixed << std::setprecision(2);
+    out << "=== Ion batch ===\n";
+    out << "jobs:          " << jobs.size() << " (" << failures << " failed)\n";
+    out << "programs:      " << programs.size() << " (" << cached << " from cache)\n";
+    out << "threads:       " << threads << "\n";
+    out << "compile:       " << compileMs << " ms\n";
+    out << "run:           " << runMs << " ms (quantum " << quantum << ")\n";
+    out << "wall:          " << wallMs << " ms\n";
+    out << "throughput:    " << jobsPerSecond << " jobs/s\n";
+    out << "instructions:  " << instructions << " (" << (runMs > 0 ? instructions / runMs / 1000.0 : 0.0) << " M/s)\n";
+    out << "output:        " << outputBytes << " bytes\n";
+    out.unsetf(std::ios::floatfield);
+}
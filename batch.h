@@ -0,0 +1,66 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "cache.h"
+#include "image.h"
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Runs a list of Ion programs concurrently. Each distinct source file is
+// compiled once into a shared ProgramImage on a work-stealing pool; every
+// job then gets its own VirtualMachine (registers, memory, output buffer)
+// and the jobs are time-sliced by the Scheduler.
+class BatchRunner {
+public:
+    explicit BatchRunner(size_t threads);
+
+    // Instructions per time slice, and an optional cap per job (0 = none)
+    void setQuantum(uint64_t instructions);
+    void setInstructionLimit(uint64_t instructions);
+    void setOptimizationLevel(int level);
+    // Programs are looked up in and added to cache; null compiles every time
+    void setCache(const CompileCache* cache);
+
+    // One .sb path per line; blank lines and lines starting with '#' are skipped
+    void loadJobs(const std::string& jobsFile);
+    void addJob(const std::string& sourceFile);
+
+    // Compiles and runs every job. Returns the number of failed jobs.
+    size_t run();
+
+    // Job output in submission order, followed by per-job errors
+    void writeOutput(std::ostream& out, std::ostream& err) const;
+    void writeReport(std::ostream& out) const;
+
+private:
+    struct Program {
+        std::string path;
+        std::shared_ptr<const ProgramImage> image;
+        std::string error;
+        bool cached = false;
+    };
+
+    struct Job {
+        size_t program;
+        std::string output;
+        std::string error;
+        uint64_t instructions = 0;
+    };
+
+    size_t threads;
+    uint64_t quantum = 10000;
+    uint64_t instructionLimit = 0;
+    int optimizationLevel = 1;
+    const CompileCache* cache = nullptr;
+    std::vector<Program> programs;
+    std::vector<Job> jobs;
+
+    double compileMs = 0;
+    double runMs = 0;
+    size_t failures = 0;
+};
+
+#endif
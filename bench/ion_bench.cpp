@@ -0,0 +1,315 @@
+// Pipeline and VM benchmark over the .sb workloads in bench/corpus.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 bench/ion_bench.cpp $(ls *.cpp | grep -v '^main.cpp$') -o ion_bench -lpthread
+//   ./ion_bench --json=baseline.json                  # record a baseline
+//   ./ion_bench --baseline=baseline.json --threshold=10 # exits 1 on a regression
+
+#include "../tokenizer.h"
+#include "../parser.h"
+#include "../codegen.h"
+#include "../binarygen.h"
+#include "../compiler.h"
+#include "../vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <dirent.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static const char *STAGES[] = {"tokenize", "parse", "codegen", "binarygen", "load", "run"};
+static const int STAGE_COUNT = 6;
+
+struct Result
+{
+    std::string name;
+    double stageMs[STAGE_COUNT] = {};
+    uint64_t instructions = 0;
+
+    double instructionsPerSecond() const
+    {
+        return stageMs[5] > 0 ? instructions / (stageMs[5] / 1000.0) : 0.0;
+    }
+};
+
+struct Options
+{
+    std::string corpus = "bench/corpus";
+    int iterations = 5;
+    std::string jsonFile;
+    std::string baselineFile;
+    double thresholdPercent = 10.0;
+    double minimumMs = 1.0; // stages faster than this are too noisy to compare
+};
+
+template <typename F>
+static double timeMs(F &&body)
+{
+    Clock::time_point start = Clock::now();
+    body();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static double median(std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    size_t middle = samples.size() / 2;
+    return samples.size() % 2 ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2;
+}
+
+static std::vector<std::string> listCorpus(const std::string &directory)
+{
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+        throw std::runtime_error("Could not open corpus directory: " + directory);
+
+    std::vector<std::string> files;
+    while (dirent *entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (hasSBSuffix(name))
+            files.push_back(name);
+    }
+    closedir(dir);
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static Result benchmark(const std::string &path, const std::string &name, int iterations)
+{
+    std::string source = readFile(path);
+    std::string binFile = "/tmp/ion_bench_" + std::to_string(getpid()) + ".bin";
+
+    std::vector<std::vector<double>> samples(STAGE_COUNT);
+    Result result;
+    result.name = name;
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        std::vector<Token> tokens;
+        std::vector<std::unique_ptr<Stmt>> ast;
+        InstructionBuffer program;
+
+        samples[0].push_back(timeMs([&]
+                                    { tokens = Tokenizer(source).tokenize(); }));
+        samples[1].push_back(timeMs([&]
+                                    { ast = Parser(tokens).parse(); }));
+        samples[2].push_back(timeMs([&]
+                                    { program = CodeGenerator().generate(ast); }));
+        samples[3].push_back(timeMs([&]
+                                    { BinaryGenerator().generateBinary(program, binFile); }));
+
+        // Output goes to memory so terminal speed does not skew print-heavy workloads
+        MemoryOutputSink sink;
+        VirtualMachine vm;
+        vm.setOutput(&sink);
+        samples[4].push_back(timeMs([&]
+                                    { vm.loadProgram(program); }));
+        samples[5].push_back(timeMs([&]
+                                    { vm.run(); }));
+
+        // Count executed instructions once, outside the timed runs
+        if (i == 0)
+        {
+            MemoryOutputSink countSink;
+            VirtualMachine counter;
+            counter.setOutput(&countSink);
+            counter.loadProgram(program);
+            if (counter.step(std::numeric_limits<int64_t>::max()) == StepStatus::Faulted)
+                throw std::runtime_error(name + ": " + counter.faultMessage());
+            result.instructions = counter.retiredInstructions();
+        }
+    }
+    std::remove(binFile.c_str());
+
+    for (int stage = 0; stage < STAGE_COUNT; ++stage)
+        result.stageMs[stage] = median(samples[stage]);
+    return result;
+}
+
+static void writeJson(const std::string &filename, const std::vector<Result> &results, int iterations)
+{
+    std::ofstream out(filename);
+    if (!out)
+        throw std::runtime_error("Could not write results: " + filename);
+
+    // One workload per line; readBaseline relies on this layout
+    out << std::fixed << std::setprecision(4);
+    out << "{\n  \"iterations\": " << iterations << ",\n  \"workloads\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result &result = results[i];
+        out << "    {\"name\": \"" << result.name << "\"";
+        for (int stage = 0; stage < STAGE_COUNT; ++stage)
+            out << ", \"" << STAGES[stage] << "_ms\": " << result.stageMs[stage];
+        out << ", \"instructions\": " << result.instructions
+            << ", \"instructions_per_second\": " << std::setprecision(0) << result.instructionsPerSecond()
+            << std::setprecision(4) << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// Reads back a file written by writeJson
+static std::map<std::string, Result> readBaseline(const std::string &filename)
+{
+    std::ifstream in(filename);
+    if (!in)
+        throw std::runtime_error("Could not open baseline: " + filename);
+
+    auto field = [](const std::string &line, const std::string &key, std::string &value)
+    {
+        size_t at = line.find("\"" + key + "\": ");
+        if (at == std::string::npos)
+            return false;
+        at += key.size() + 4;
+        size_t end = line.find_first_of(",}", at);
+        value = line.substr(at, end - at);
+        if (!value.empty() && value.front() == '"')
+            value = value.substr(1, value.size() - 2);
+        return true;
+    };
+
+    std::map<std::string, Result> baseline;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        Result result;
+        std::string value;
+        if (!field(line, "name", result.name))
+            continue;
+        for (int stage = 0; stage < STAGE_COUNT; ++stage)
+        {
+            if (field(line, std::string(STAGES[stage]) + "_ms", value))
+                result.stageMs[stage] = std::stod(value);
+        }
+        if (field(line, "instructions", value))
+            result.instructions = std::stoull(value);
+        baseline[result.name] = result;
+    }
+    return baseline;
+}
+
+// Returns the number of regressions beyond the threshold
+static int compare(const std::vector<Result> &results, const std::map<std::string, Result> &baseline, const Options &options)
+{
+    int regressions = 0;
+    std::cout << "\n-- against baseline (threshold " << options.thresholdPercent << "%) --\n";
+    for (const Result &result : results)
+    {
+        auto it = baseline.find(result.name);
+        if (it == baseline.end())
+        {
+            std::cout << "  " << result.name << ": not in baseline\n";
+            continue;
+        }
+
+        for (int stage = 0; stage < STAGE_COUNT; ++stage)
+        {
+            double before = it->second.stageMs[stage];
+            double now = result.stageMs[stage];
+            if (before < options.minimumMs)
+                continue;
+
+            double change = (now - before) / before * 100.0;
+            bool regressed = change > options.thresholdPercent;
+            if (regressed)
+                ++regressions;
+            std::cout << "  " << std::left << std::setw(12) << result.name << std::setw(10) << STAGES[stage] << std::right
+                      << std::setw(10) << before << " -> " << std::setw(10) << now << " ms  "
+                      << std::showpos << change << "%" << std::noshowpos << (regressed ? "  REGRESSION" : "") << "\n";
+        }
+    }
+    return regressions;
+}
+
+static Options parseOptions(int argc, char *argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--corpus=", 0) == 0)
+            options.corpus = arg.substr(9);
+        else if (arg.rfind("--iterations=", 0) == 0)
+            options.iterations = std::stoi(arg.substr(13));
+        else if (arg.rfind("--json=", 0) == 0)
+            options.jsonFile = arg.substr(7);
+        else if (arg.rfind("--baseline=", 0) == 0)
+            options.baselineFile = arg.substr(11);
+        else if (arg.rfind("--threshold=", 0) == 0)
+            options.thresholdPercent = std::stod(arg.substr(12));
+        else if (arg.rfind("--min-ms=", 0) == 0)
+            options.minimumMs = std::stod(arg.substr(9));
+        else
+            throw std::runtime_error("Unknown option: " + arg +
+                                     "\nUsage: ion_bench [--corpus=dir] [--iterations=N] [--json=file] "
+                                     "[--baseline=file] [--threshold=percent] [--min-ms=ms]");
+    }
+    if (options.iterations < 1)
+        throw std::runtime_error("--iterations must be at least 1");
+    return options;
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        Options options = parseOptions(argc, argv);
+
+        std::vector<Result> results;
+        for (const std::string &file : listCorpus(options.corpus))
+        {
+            std::string name = file.substr(0, file.size() - 3);
+            results.push_back(benchmark(options.corpus + "/" + file, name, options.iterations));
+        }
+        if (results.empty())
+            throw std::runtime_error("No .sb workloads in " + options.corpus);
+
+        std::cout << std::fixed << std::setprecision(3);
+        std::cout << "median of " << options.iterations << " iterations, ms\n";
+        std::cout << std::left << std::setw(12) << "workload" << std::right;
+        for (const char *stage : STAGES)
+            std::cout << std::setw(11) << stage;
+        std::cout << std::setw(14) << "instructions" << std::setw(10) << "MIPS" << "\n";
+
+        for (const Result &result : results)
+        {
+            std::cout << std::left << std::setw(12) << result.name << std::right;
+            for (double ms : result.stageMs)
+                std::cout << std::setw(11) << ms;
+            std::cout << std::setw(14) << result.instructions << std::setw(10) << std::setprecision(1)
+                      << result.instructionsPerSecond() / 1e6 << std::setprecision(3) << "\n";
+        }
+
+        if (!options.jsonFile.empty())
+            writeJson(options.jsonFile, results, options.iterations);
+
+        if (!options.baselineFile.empty())
+        {
+            int regressions = compare(results, readBaseline(options.baselineFile), options);
+            if (regressions > 0)
+            {
+                std::cerr << regressions << " stage(s) regressed beyond " << options.thresholdPercent << "%\n";
+                return 1;
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,14 +1,17 @@
 #include "bin2asm.h"
+#include "bytecode.h"
+#include "opcodes.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <unordered_map>
 #include <bitset>
+#include <map>
 
 std::string BinToAsmConverter::decodeInstruction(uint8_t opcode, uint8_t a1, uint8_t a2, uint8_t a3)
 {
     static std::unordered_map<uint8_t, std::string> opMap = {
-        {0x01, "LOAD"}, {0x02, "MOV"}, {0x03, "ADD"}, {0x04, "SUB"}, {0x05, "MUL"}, {0x06, "DIV"}, {0x07, "CMP"}, {0x08, "JMP"}, {0x09, "JE"}, {0x0A, "JNE"}, {0x0B, "JLT"}, {0x0C, "JGT"}, {0x0D, "JLE"}, {0x0E, "JGE"}, {0x0F, "PRINTS"}, {0x11, "PRINT"}, {0x10, "HALT"}, {0xFD, "DATA"}, {0xFE, "LABEL"}};
+        {0x01, "LOAD"}, {0x02, "MOV"}, {0x03, "ADD"}, {0x04, "SUB"}, {0x05, "MUL"}, {0x06, "DIV"}, {0x07, "CMP"}, {0x08, "JMP"}, {0x09, "JE"}, {0x0A, "JNE"}, {0x0B, "JLT"}, {0x0C, "JGT"}, {0x0D, "JLE"}, {0x0E, "JGE"}, {0x0F, "PRINTS"}, {0x11, "PRINT"}, {0x10, "HALT"}, {0x12, "LDM"}, {0x13, "STM"}, {0x14, "ADDI"}, {0x15, "SUBI"}, {0x16, "MULI"}, {0x17, "DIVI"}, {0x18, "CMPI"}, {0x19, "SHL"}, {0x1A, "SHR"}, {0x1B, "SAR"}, {0x1C, "AND"}, {0x1D, "SHLI"}, {0x1E, "SHRI"}, {0x1F, "SARI"}, {0x20, "ANDI"}, {0xFD, "DATA"}, {0xFE, "LABEL"}};
 
     static std::unordered_map<uint8_t, std::string> regMap = {
         {0, "R0"}, {1, "R1"}, {2, "R2"}, {3, "R3"}, {4, "R4"}, {5, "R5"}, {6, "R6"}, {7, "R7"}, {8, "R8"}, {9, "R9"}};
@@ -34,15 +37,25 @@ std::string BinToAsmConverter::decodeInstruction(uint8_t opcode, uint8_t a1, uin
     switch (opcode)
     {
     case 0x01: // LOAD reg, immediate
-    case 0x07: // CMP reg, immediate
         result << " " << reg(a1) << ", " << std::to_string(a2);
         break;
 
+    case 0x07: // CMP reg, immediate or CMP reg, reg
+        if (a3 & CMP_REGISTER_OPERAND)
+            result << " " << reg(a1) << ", " << reg(a2);
+        else
+            result << " " << reg(a1) << ", " << std::to_string(a2);
+        break;
+
     case 0x02: // MOV reg1, reg2
     case 0x03:
     case 0x04:
     case 0x05:
     case 0x06: // ADD, SUB, MUL, DIV
+    case 0x19:
+    case 0x1A:
+    case 0x1B:
+    case 0x1C: // SHL, SHR, SAR, AND
         result << " " << reg(a1) << ", " << reg(a2);
         break;
 
@@ -64,6 +77,23 @@ std::string BinToAsmConverter::decodeInstruction(uint8_t opcode, uint8_t a1, uin
         result << " R" << std::to_string(a1);
         break;
 
+    case 0x12:
+    case 0x13: // LDM / STM reg, 16-bit address
+        result << " " << reg(a1) << ", " << std::to_string(a2 | (a3 << 8));
+        break;
+
+    case 0x14:
+    case 0x15:
+    case 0x16:
+    case 0x17:
+    case 0x18:
+    case 0x1D:
+    case 0x1E:
+    case 0x1F:
+    case 0x20: // ADDI..CMPI, SHLI..ANDI reg, signed 16-bit immediate
+        result << " " << reg(a1) << ", " << std::to_string(static_cast<int16_t>(a2 | (a3 << 8)));
+        break;
+
     default:
         result << " " << std::to_string(a1) << ", " << std::to_string(a2);
         break;
@@ -72,6 +102,83 @@ std::string BinToAsmConverter::decodeInstruction(uint8_t opcode, uint8_t a1, uin
     return result.str();
 }
 
+// Names come from the debug section when there is one; otherwise labels
+// are named after their instruction index and strings after their offset
+void BinToAsmConverter::convertVersion2(const std::vector<uint8_t> &bytes, std::ostream &out)
+{
+    BytecodeFile file = BytecodeFile::parse(bytes);
+    auto isJump = [](Opcode op) { return op >= Opcode::JMP && op <= Opcode::JGE; };
+
+    std::map<uint32_t, std::vector<std::string>> labelsAt;
+    for (const auto &label : file.labelNames)
+        labelsAt[label.first].push_back(label.second);
+    auto labelFor = [&](uint32_t index) -> const std::string &
+    {
+        std::vector<std::string> &names = labelsAt[index];
+        if (names.empty())
+            names.push_back("label_" + std::to_string(index));
+        return names.front();
+    };
+    auto stringFor = [&](uint32_t offset)
+    {
+        auto it = file.stringNames.find(offset);
+        return it != file.stringNames.end() ? it->second : "str_" + std::to_string(offset);
+    };
+
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < file.code.size(); ++i)
+    {
+        const BytecodeFile::Record &record = file.code[i];
+        std::string line = opcodeName(record.opcode);
+        std::string a = "R" + std::to_string(record.a);
+        switch (record.opcode)
+        {
+        case Opcode::HALT:
+            break;
+        case Opcode::PRINT:
+            line += " " + a;
+            break;
+        case Opcode::PRINTS:
+            line += " " + stringFor(static_cast<uint32_t>(record.operand));
+            break;
+        case Opcode::MOV:
+        case Opcode::ADD:
+        case Opcode::SUB:
+        case Opcode::MUL:
+        case Opcode::DIV:
+        case Opcode::CMP:
+        case Opcode::SHL:
+        case Opcode::SHR:
+        case Opcode::SAR:
+        case Opcode::AND:
+            line += " " + a + ", R" + std::to_string(record.b);
+            break;
+        default:
+            if (isJump(record.opcode))
+                line += " " + labelFor(static_cast<uint32_t>(i + 1 + static_cast<int64_t>(record.operand)));
+            else
+                line += " " + a + ", " + std::to_string(record.operand);
+            break;
+        }
+        lines.push_back(line);
+    }
+
+    // Labels are all known once every jump has been seen
+    for (size_t i = 0; i <= file.code.size(); ++i)
+    {
+        auto it = labelsAt.find(static_cast<uint32_t>(i));
+        if (it != labelsAt.end())
+        {
+            for (const std::string &name : it->second)
+                out << "LABEL " << name << std::endl;
+        }
+        if (i < lines.size())
+            out << lines[i] << std::endl;
+    }
+    for (const auto &entry : file.strings)
+        out << "DATA " << stringFor(entry.first) << " \"" << entry.second << "\"" << std::endl;
+}
+
 void BinToAsmConverter::convert(const std::string &bitFile, const std::string &asmOutputFile)
 {
     std::ifstream in(bitFile);
@@ -103,6 +210,13 @@ void BinToAsmConverter::convert(const std::string &bitFile, const std::string &a
 
     in.close();
 
+    if (BytecodeFile::isVersion2(bytes))
+    {
+        convertVersion2(bytes, out);
+        out.close();
+        return;
+    }
+
     size_t i = 0;
     while (i + 3 < bytes.size())
     {
@@ -1,6 +1,8 @@
 #ifndef BIN2ASM_H
 #define BIN2ASM_H
 
+#include <cstdint>
+#include <ostream>
 #include <string>
 #include <vector>
 
@@ -10,6 +12,7 @@ public:
 
 private:
     std::string decodeInstruction(uint8_t opcode, uint8_t a1, uint8_t a2, uint8_t a3);
+    void convertVersion2(const std::vector<uint8_t> &bytes, std::ostream &out);
 };
 
 #endif
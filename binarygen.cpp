@@ -1,56 +1,52 @@
 #include "binarygen.h"
+#include "bytecode.h"
 #include <fstream>
-#include <sstream>
 #include <iostream>
 #include <stdexcept>
-#include <unordered_set>
 
-void BinaryGenerator::initializeMaps()
+static void appendPadded(std::vector<uint8_t> &out, const std::string &text)
 {
-    opcodeMap = {
-        {"LOAD", 0x01},
-        {"MOV", 0x02},
-        {"ADD", 0x03},
-        {"SUB", 0x04},
-        {"MUL", 0x05},
-        {"DIV", 0x06},
-        {"CMP", 0x07},
-        {"JMP", 0x08},
-        {"JE", 0x09},
-        {"JNE", 0x0A},
-        {"JLT", 0x0B},
-        {"JGT", 0x0C},
-        {"JLE", 0x0D},
-        {"JGE", 0x0E},
-        {"PRINTS", 0x0F},
-        {"PRINT", 0x11},
-        {"HALT", 0x10},
-        {"DATA", 0xFD},
-        {"LABEL", 0xFE}};
-
-    for (int i = 0; i <= 9; ++i)
-        registerMap["R" + std::to_string(i)] = i;
+    out.insert(out.end(), text.begin(), text.end());
+    out.resize((out.size() + 3) & ~static_cast<size_t>(3), 0x00);
 }
 
-void BinaryGenerator::resolveLabelsAndStrings(const std::vector<std::string> &asmCode)
+// Labels become instruction indices and strings pool offsets. Strings
+// enter the pool in the order their DATA lines appear, so the loader
+// numbers them the same way the text path does.
+void BinaryGenerator::layout(const InstructionBuffer &program)
 {
-    int labelId = 0;
-    int strId = 0;
-    for (const auto &line : asmCode)
+    labelToIndex.assign(program.labelCount(), -1);
+    stringToOffset.assign(program.stringCount(), -1);
+    pool.clear();
+    poolOffsets.clear();
+
+    int index = 0;
+    for (const Instruction &instr : program.code)
     {
-        std::istringstream iss(line);
-        std::string word, label;
-        iss >> word >> label;
+        if (instr.opcode == Opcode::LABEL)
+            labelToIndex[instr.a.value] = index;
+        else if (instr.opcode == Opcode::DATA)
+            stringOffset(program, instr.a.value);
+        else
+            ++index;
+    }
+}
 
-        if (word == "LABEL")
-        {
-            labelToId[label] = labelId++;
-        }
-        else if (word == "DATA")
-        {
-            stringToId[label] = strId++;
-        }
+int BinaryGenerator::stringOffset(const InstructionBuffer &program, int id)
+{
+    if (stringToOffset[id] >= 0)
+        return stringToOffset[id];
+
+    const std::string &text = program.stringText(id);
+    auto it = poolOffsets.find(text);
+    if (it == poolOffsets.end())
+    {
+        it = poolOffsets.emplace(text, static_cast<int>(pool.size())).first;
+        appendU32(pool, static_cast<uint32_t>(text.size()));
+        appendPadded(pool, text);
     }
+    stringToOffset[id] = it->second;
+    return it->second;
 }
 
 void writeBinaryAsBitLines(const std::string &binFilename, const std::string &txtFilename)
@@ -82,91 +78,94 @@ void writeBinaryAsBitLines(const std::string &binFilename, const std::string &tx
     out.close();
 }
 
-std::vector<uint8_t> BinaryGenerator::encodeInstruction(const std::string &line)
+void BinaryGenerator::encodeInstruction(std::vector<uint8_t> &out, const InstructionBuffer &program,
+                                        const Instruction &instr, int index)
 {
-    std::istringstream iss(line);
-    std::string word;
-    iss >> word;
-
-    std::vector<uint8_t> bytes;
+    Opcode opcode = instr.opcode;
+    uint8_t a = instr.a.isRegister() ? static_cast<uint8_t>(instr.a.value) : 0;
+    uint8_t b = instr.b.isRegister() ? static_cast<uint8_t>(instr.b.value) : 0;
+    int32_t operand = 0;
 
-    if (word == "LABEL")
+    if (instr.a.kind == OperandKind::Label)
     {
-        std::string label;
-        iss >> label;
-        bytes = {0xFE, labelToId[label], 0x00, 0x00};
+        int target = labelToIndex[instr.a.value];
+        if (target < 0)
+            throw std::runtime_error("Unknown label: " + program.labelName(instr.a.value));
+        operand = target - (index + 1);
     }
-    else if (word == "DATA")
+    else if (instr.a.kind == OperandKind::String)
     {
-        std::string label, str;
-        iss >> label;
-        std::getline(iss, str);
-        str = str.substr(str.find_first_of('"') + 1);
-        str.pop_back();
-        bytes = {0xFD, stringToId[label], static_cast<uint8_t>(str.size()), 0x00};
-        for (char c : str)
-            bytes.push_back(static_cast<uint8_t>(c));
-
-        // Pad to 4-byte boundary
-        size_t totalSize = bytes.size();
-        size_t padding = (4 - (totalSize % 4)) % 4;
-        for (size_t i = 0; i < padding; ++i)
-            bytes.push_back(0x00);
+        operand = stringOffset(program, instr.a.value);
     }
-    else if (opcodeMap.count(word))
+    else if (instr.b.kind == OperandKind::Immediate || instr.b.kind == OperandKind::Address)
     {
-        uint8_t opcode = opcodeMap[word];
-        std::string arg1, arg2;
-        iss >> arg1 >> arg2;
+        operand = instr.b.value;
+    }
 
-        auto clean = [](std::string s)
-        {
-            while (!s.empty() && (s.back() == ',' || s.back() == ' ' || s.back() == '\t'))
-                s.pop_back();
-            while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
-                s.erase(s.begin());
-            return s;
-        };
+    if (opcode == Opcode::CMP && !instr.b.isRegister())
+        opcode = Opcode::CMPI;
+
+    out.insert(out.end(), {static_cast<uint8_t>(opcode), a, b, 0x00});
+    appendU32(out, static_cast<uint32_t>(operand));
+}
 
-        arg1 = clean(arg1);
-        arg2 = clean(arg2);
+std::vector<uint8_t> BinaryGenerator::encodeDebug(const InstructionBuffer &program) const
+{
+    std::vector<uint8_t> debug;
+    auto name = [&](uint8_t kind, int value, const std::string &text)
+    {
+        if (text.size() > 0xFFFF)
+            throw std::runtime_error("Name too long for program.bin: " + text.substr(0, 32) + "...");
+        debug.insert(debug.end(), {kind, 0x00});
+        appendU16(debug, static_cast<uint16_t>(text.size()));
+        appendU32(debug, static_cast<uint32_t>(value));
+        appendPadded(debug, text);
+    };
+
+    for (const Instruction &instr : program.code)
+    {
+        if (instr.opcode == Opcode::LABEL)
+            name(DEBUG_LABEL_NAME, labelToIndex[instr.a.value], program.labelName(instr.a.value));
+        else if (instr.opcode == Opcode::DATA)
+            name(DEBUG_STRING_NAME, stringToOffset[instr.a.value], program.stringName(instr.a.value));
+    }
+    return debug;
+}
 
-        auto getVal = [&](const std::string &token) -> uint8_t
-        {
-            if (registerMap.count(token))
-                return registerMap[token];
-            else if (labelToId.count(token))
-                return labelToId[token];
-            else if (stringToId.count(token))
-                return stringToId[token];
-            else
-                return static_cast<uint8_t>(std::stoi(token));
-        };
-
-        bytes = {opcode, 0x00, 0x00, 0x00};
-        if (!arg1.empty())
-            bytes[1] = getVal(arg1);
-        if (!arg2.empty())
-            bytes[2] = getVal(arg2);
+std::vector<uint8_t> BinaryGenerator::encode(const InstructionBuffer &program)
+{
+    layout(program);
+
+    std::vector<uint8_t> code;
+    code.reserve(BYTECODE_INSTRUCTION_SIZE * program.code.size());
+    int index = 0;
+    for (const Instruction &instr : program.code)
+    {
+        if (instr.opcode != Opcode::LABEL && instr.opcode != Opcode::DATA)
+            encodeInstruction(code, program, instr, index++);
     }
-    return bytes;
+    std::vector<uint8_t> debug = encodeDebug(program);
+
+    std::vector<uint8_t> binary(BYTECODE_MAGIC, BYTECODE_MAGIC + sizeof(BYTECODE_MAGIC));
+    appendU16(binary, BYTECODE_VERSION);
+    appendU16(binary, debug.empty() ? 0 : BYTECODE_HAS_DEBUG);
+    appendU32(binary, static_cast<uint32_t>(index));
+    appendU32(binary, static_cast<uint32_t>(pool.size()));
+    appendU32(binary, static_cast<uint32_t>(debug.size()));
+    binary.reserve(binary.size() + code.size() + pool.size() + debug.size());
+    binary.insert(binary.end(), code.begin(), code.end());
+    binary.insert(binary.end(), pool.begin(), pool.end());
+    binary.insert(binary.end(), debug.begin(), debug.end());
+    return binary;
 }
 
-void BinaryGenerator::generateBinary(const std::vector<std::string> &asmCode, const std::string &outFilename)
+void BinaryGenerator::generateBinary(const InstructionBuffer &program, const std::string &outFilename)
 {
-    initializeMaps();
-    resolveLabelsAndStrings(asmCode);
+    std::vector<uint8_t> binary = encode(program);
 
     std::ofstream out(outFilename, std::ios::binary);
     if (!out)
         throw std::runtime_error("Could not open output file: " + outFilename);
-
-    for (const auto &line : asmCode)
-    {
-        auto bytes = encodeInstruction(line);
-        if (!bytes.empty())
-            out.write(reinterpret_cast<char *>(bytes.data()), bytes.size());
-    }
-
+    out.write(reinterpret_cast<const char *>(binary.data()), binary.size());
     out.close();
 }
@@ -1,25 +1,31 @@
 #ifndef BINARYGEN_H
 #define BINARYGEN_H
 
+#include "instruction.h"
 #include <string>
-#include <vector>
 #include <unordered_map>
+#include <vector>
 
+// Writes program.bin version 2, laid out as described in bytecode.h
 class BinaryGenerator
 {
 public:
-    // Converts assembly code to binary and writes to output file
-    void generateBinary(const std::vector<std::string>& asmCode, const std::string& outFilename);
+    // The program.bin bytes for the program
+    std::vector<uint8_t> encode(const InstructionBuffer& program);
+    // Encodes the program and writes it to the output file
+    void generateBinary(const InstructionBuffer& program, const std::string& outFilename);
 
 private:
-    std::unordered_map<std::string, uint8_t> opcodeMap;
-    std::unordered_map<std::string, uint8_t> registerMap;
-    std::unordered_map<std::string, uint8_t> labelToId;
-    std::unordered_map<std::string, uint8_t> stringToId;
+    std::vector<int> labelToIndex;    // buffer label id -> instruction index
+    std::vector<int> stringToOffset;  // buffer string id -> string pool offset
+    std::vector<uint8_t> pool;
+    std::unordered_map<std::string, int> poolOffsets; // text -> offset, so equal strings share an entry
 
-    void initializeMaps();
-    void resolveLabelsAndStrings(const std::vector<std::string>& asmCode);
-    std::vector<uint8_t> encodeInstruction(const std::string& line);
+    void layout(const InstructionBuffer& program);
+    int stringOffset(const InstructionBuffer& program, int id);
+    void encodeInstruction(std::vector<uint8_t>& out, const InstructionBuffer& program, const Instruction& instr,
+                           int index);
+    std::vector<uint8_t> encodeDebug(const InstructionBuffer& program) const;
 };
 
 #endif
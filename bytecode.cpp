@@ -0,0 +1,72 @@
+#include "bytecode.h"
+#include <cstring>
+#include <stdexcept>
+
+static size_t padded(size_t size)
+{
+    return (size + 3) & ~static_cast<size_t>(3);
+}
+
+bool BytecodeFile::isVersion2(const std::vector<uint8_t> &bytes)
+{
+    return bytes.size() >= sizeof(BYTECODE_MAGIC) &&
+           std::memcmp(bytes.data(), BYTECODE_MAGIC, sizeof(BYTECODE_MAGIC)) == 0;
+}
+
+BytecodeFile BytecodeFile::parse(const std::vector<uint8_t> &bytes)
+{
+    if (!isVersion2(bytes) || bytes.size() < BYTECODE_HEADER_SIZE)
+        throw std::runtime_error("Not a version 2 program image");
+    const uint8_t *header = bytes.data();
+    uint16_t version = readU16(header + 4);
+    if (version != BYTECODE_VERSION)
+        throw std::runtime_error("Unsupported program image version: " + std::to_string(version));
+
+    BytecodeFile file;
+    file.hasDebug = readU16(header + 6) & BYTECODE_HAS_DEBUG;
+    uint64_t count = readU32(header + 8);
+    uint64_t poolSize = readU32(header + 12);
+    uint64_t debugSize = readU32(header + 16);
+    uint64_t codeSize = count * BYTECODE_INSTRUCTION_SIZE;
+    if (BYTECODE_HEADER_SIZE + codeSize + poolSize + debugSize != bytes.size() || poolSize % 4 || debugSize % 4 ||
+        (debugSize && !file.hasDebug))
+        throw std::runtime_error("Corrupt program image: section sizes do not match the file");
+
+    const uint8_t *code = header + BYTECODE_HEADER_SIZE;
+    file.code.reserve(count);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        const uint8_t *record = code + i * BYTECODE_INSTRUCTION_SIZE;
+        file.code.push_back({static_cast<Opcode>(record[0]), record[1], record[2],
+                             static_cast<int32_t>(readU32(record + 4))});
+    }
+
+    const uint8_t *pool = code + codeSize;
+    for (size_t offset = 0; offset < poolSize;)
+    {
+        size_t length = readU32(pool + offset);
+        if (length > poolSize - offset - 4)
+            throw std::runtime_error("Truncated string in program image at offset " + std::to_string(offset));
+        file.strings.emplace_back(offset, std::string(reinterpret_cast<const char *>(pool + offset + 4), length));
+        offset += 4 + padded(length);
+    }
+
+    const uint8_t *debug = pool + poolSize;
+    for (size_t offset = 0; offset < debugSize;)
+    {
+        if (debugSize - offset < 8)
+            throw std::runtime_error("Truncated debug section in program image");
+        uint8_t kind = debug[offset];
+        size_t length = readU16(debug + offset + 2);
+        uint32_t value = readU32(debug + offset + 4);
+        if (length > debugSize - offset - 8)
+            throw std::runtime_error("Truncated debug section in program image");
+        std::string name(reinterpret_cast<const char *>(debug + offset + 8), length);
+        if (kind == DEBUG_LABEL_NAME)
+            file.labelNames.emplace_back(value, std::move(name));
+        else if (kind == DEBUG_STRING_NAME)
+            file.stringNames.emplace(value, std::move(name));
+        offset += 8 + padded(length);
+    }
+    return file;
+}
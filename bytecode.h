@@ -0,0 +1,82 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "opcodes.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// program.bin, version 2. Every field is little-endian and every section
+// is padded with zeros to a multiple of 4 bytes.
+//
+//   header   "IONB", u16 version, u16 flags, u32 instruction count,
+//            u32 string pool size, u32 debug section size
+//   code     8 bytes per instruction: u8 opcode, u8 a, u8 b, u8 0,
+//            i32 operand
+//   strings  per string: u32 length, then the text padded to 4 bytes
+//   debug    present when BYTECODE_HAS_DEBUG is set; per name: u8 kind,
+//            u8 0, u16 length, u32 value, then the name padded to 4 bytes
+//
+// a is the first register and b the second. The operand holds LOAD and
+// immediate-op values, LDM / STM addresses, jump offsets in instructions
+// from the next one, and PRINTS string offsets into the pool. CMP against
+// an immediate is written as CMPI. Files without the magic are version 1.
+constexpr char BYTECODE_MAGIC[4] = {'I', 'O', 'N', 'B'};
+constexpr uint16_t BYTECODE_VERSION = 2;
+constexpr uint16_t BYTECODE_HAS_DEBUG = 0x0001;
+constexpr size_t BYTECODE_HEADER_SIZE = 20;
+constexpr size_t BYTECODE_INSTRUCTION_SIZE = 8;
+
+// Debug section kinds: the value is an instruction index for a label and
+// a pool offset for a string
+constexpr uint8_t DEBUG_LABEL_NAME = 1;
+constexpr uint8_t DEBUG_STRING_NAME = 2;
+
+inline void appendU16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+inline void appendU32(std::vector<uint8_t> &out, uint32_t value)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+        out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+inline uint16_t readU16(const uint8_t *bytes)
+{
+    return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+inline uint32_t readU32(const uint8_t *bytes)
+{
+    return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+           (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+// The sections of a version 2 file, bounds-checked but not otherwise
+// interpreted: jump offsets and string offsets are left as written.
+struct BytecodeFile
+{
+    struct Record
+    {
+        Opcode opcode;
+        uint8_t a;
+        uint8_t b;
+        int32_t operand;
+    };
+
+    std::vector<Record> code;
+    std::vector<std::pair<uint32_t, std::string>> strings; // pool offset, text
+    std::vector<std::pair<uint32_t, std::string>> labelNames; // instruction index, name
+    std::unordered_map<uint32_t, std::string> stringNames;    // pool offset -> first name
+    bool hasDebug = false;
+
+    static bool isVersion2(const std::vector<uint8_t> &bytes);
+    static BytecodeFile parse(const std::vector<uint8_t> &bytes);
+};
+
+#endif
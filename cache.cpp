@@ -0,0 +1,142 @@
+#include "cache.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// On disk: "IONC", the entry format version and the compiler version,
+// then the source and the bytecode, each preceded by its size. Fields are
+// in host order.
+static const char CACHE_MAGIC[4] = {'I', 'O', 'N', 'C'};
+static const uint32_t CACHE_FORMAT_VERSION = 1;
+
+// Entries larger than this are not trusted when read back
+static const uint64_t MAX_ENTRY_PART = 64u << 20;
+
+// FNV-1a
+static uint64_t mix(uint64_t h, const void *data, size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Creates directory and any missing parents
+static bool makeDirectories(const std::string &directory)
+{
+    for (size_t slash = directory.find('/', 1);; slash = directory.find('/', slash + 1))
+    {
+        std::string prefix = directory.substr(0, slash);
+        if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+        if (slash == std::string::npos)
+            return true;
+    }
+}
+
+std::string CompileCache::defaultDirectory()
+{
+    const char *cacheHome = std::getenv("XDG_CACHE_HOME");
+    if (cacheHome && *cacheHome)
+        return std::string(cacheHome) + "/ion";
+    const char *home = std::getenv("HOME");
+    if (home && *home)
+        return std::string(home) + "/.cache/ion";
+    return "";
+}
+
+CompileCache::CompileCache(std::string directory) : directory(std::move(directory)) {}
+
+std::string CompileCache::key(const std::string &source, const CompileOptions &options)
+{
+    uint64_t h = 14695981039346656037ULL;
+    uint32_t version = COMPILER_VERSION;
+    int32_t level = options.optimizationLevel;
+    int32_t unroll = options.unrollFactor;
+    uint64_t size = source.size();
+    h = mix(h, &version, sizeof(version));
+    h = mix(h, &level, sizeof(level));
+    h = mix(h, &unroll, sizeof(unroll));
+    h = mix(h, &size, sizeof(size));
+    h = mix(h, source.data(), source.size());
+
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(h));
+    return std::string(hex) + "-O" + std::to_string(level);
+}
+
+std::string CompileCache::entryPath(const std::string &key) const
+{
+    return directory + "/" + key + ".ionc";
+}
+
+bool CompileCache::load(const std::string &key, const std::string &source, std::vector<uint8_t> &bytecode) const
+{
+    if (directory.empty())
+        return false;
+    std::ifstream in(entryPath(key), std::ios::binary);
+    if (!in)
+        return false;
+
+    char magic[4];
+    uint32_t format = 0;
+    uint32_t version = 0;
+    uint64_t sourceSize = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char *>(&format), sizeof(format));
+    in.read(reinterpret_cast<char *>(&version), sizeof(version));
+    in.read(reinterpret_cast<char *>(&sourceSize), sizeof(sourceSize));
+    if (!in || std::memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 || format != CACHE_FORMAT_VERSION ||
+        version != COMPILER_VERSION || sourceSize != source.size())
+        return false;
+
+    std::string cachedSource(sourceSize, '\0');
+    in.read(&cachedSource[0], sourceSize);
+    if (!in || cachedSource != source)
+        return false;
+
+    uint64_t codeSize = 0;
+    in.read(reinterpret_cast<char *>(&codeSize), sizeof(codeSize));
+    if (!in || codeSize > MAX_ENTRY_PART)
+        return false;
+    std::vector<uint8_t> code(codeSize);
+    in.read(reinterpret_cast<char *>(code.data()), codeSize);
+    if (!in)
+        return false;
+    bytecode = std::move(code);
+    return true;
+}
+
+void CompileCache::store(const std::string &key, const std::string &source, const std::vector<uint8_t> &bytecode) const
+{
+    if (directory.empty() || !makeDirectories(directory))
+        return;
+
+    // Unique per process and call, so concurrent writers never share a file
+    static std::atomic<unsigned> counter{0};
+    std::string path = entryPath(key);
+    std::string temporary = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(counter++);
+
+    std::ofstream out(temporary, std::ios::binary);
+    uint64_t sourceSize = source.size();
+    uint64_t codeSize = bytecode.size();
+    out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    out.write(reinterpret_cast<const char *>(&CACHE_FORMAT_VERSION), sizeof(CACHE_FORMAT_VERSION));
+    out.write(reinterpret_cast<const char *>(&COMPILER_VERSION), sizeof(COMPILER_VERSION));
+    out.write(reinterpret_cast<const char *>(&sourceSize), sizeof(sourceSize));
+    out.write(source.data(), source.size());
+    out.write(reinterpret_cast<const char *>(&codeSize), sizeof(codeSize));
+    out.write(reinterpret_cast<const char *>(bytecode.data()), bytecode.size());
+    out.close();
+
+    if (!out || std::rename(temporary.c_str(), path.c_str()) != 0)
+        std::remove(temporary.c_str());
+}
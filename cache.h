@@ -0,0 +1,33 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "compiler.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compiled program.bin bytes, stored one file per key under a directory.
+// The key hashes the source, COMPILER_VERSION and the options that change
+// the output; each entry also keeps its source, so a hash collision reads
+// as a miss. Entries are written to a temporary file and renamed into
+// place, so concurrent runs see a whole entry or none. Cache failures are
+// never errors: a bad entry is a miss and a failed write is dropped.
+class CompileCache {
+public:
+    // $XDG_CACHE_HOME/ion, else $HOME/.cache/ion; empty when neither is set
+    static std::string defaultDirectory();
+
+    explicit CompileCache(std::string directory);
+
+    static std::string key(const std::string& source, const CompileOptions& options);
+
+    bool load(const std::string& key, const std::string& source, std::vector<uint8_t>& bytecode) const;
+    void store(const std::string& key, const std::string& source, const std::vector<uint8_t>& bytecode) const;
+
+private:
+    std::string directory;
+
+    std::string entryPath(const std::string& key) const;
+};
+
+#endif
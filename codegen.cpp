@@ -1,205 +1,526 @@
 #include "codegen.h"
-#include <sstream>
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include "opcodes.h"
 
-CodeGenerator::CodeGenerator() : registerCounter(1), labelCounter(0) {}
+// Variables are allocated to R1-R5. R0 holds conditions and print
+// operands, and R6/R7 are expression temporaries.
+static const int FIRST_VARIABLE_REGISTER = 1;
+static const int LAST_VARIABLE_REGISTER = 5;
 
-std::string CodeGenerator::newLabel(const std::string &base)
+// The top words of VM memory save temporaries borrowed by expressions
+// too deep for the free registers.
+static const int SCRATCH_SAVE_SLOTS = 16;
+
+CodeGenerator::CodeGenerator() : labelCounter(0) {}
+
+// A literal that fits the signed 32-bit immediate operand of ADDI..CMPI
+static bool getImmediate(Expr *expr, int &value)
+{
+    if (expr->type != ExprType::LITERAL)
+        return false;
+
+    const std::string &text = static_cast<LiteralExpr *>(expr)->value;
+    if (text == "true" || text == "false")
+    {
+        value = text == "true" ? 1 : 0;
+        return true;
+    }
+
+    long long parsed = std::stoll(text);
+    if (parsed < IMMEDIATE_MIN || parsed > IMMEDIATE_MAX)
+        return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+// LOAD's operand; wider literals wrap to 32 bits like the VM's arithmetic
+static int32_t literalValue(const std::string &text)
+{
+    if (text == "true" || text == "false")
+        return text == "true" ? 1 : 0;
+    return static_cast<int32_t>(static_cast<uint32_t>(std::stoll(text)));
+}
+
+// The comparison that holds with its operands swapped
+static std::string mirrorComparison(const std::string &op)
+{
+    if (op == "<")
+        return ">";
+    if (op == ">")
+        return "<";
+    if (op == "<=")
+        return ">=";
+    if (op == ">=")
+        return "<=";
+    return op;
+}
+
+int CodeGenerator::newLabel(const std::string &base, InstructionBuffer &output)
+{
+    return output.label(base + "_" + std::to_string(labelCounter++));
+}
+
+const VariableLocation &CodeGenerator::getLocationForVariable(const std::string &name)
 {
-    return base + "_" + std::to_string(labelCounter++);
+    auto it = variableLocations.find(name);
+    if (it == variableLocations.end())
+        throw std::runtime_error("No storage allocated for variable: " + name);
+    return it->second;
 }
 
-std::string CodeGenerator::getRegisterForVariable(const std::string &name)
+// Spilled variables are computed into R0 and then written to memory
+void CodeGenerator::storeVariable(const std::string &name, Expr *value, InstructionBuffer &output)
 {
-    if (variableToRegister.find(name) == variableToRegister.end())
+    const VariableLocation &location = getLocationForVariable(name);
+    if (location.spilled())
     {
-        variableToRegister[name] = "R" + std::to_string(registerCounter++);
+        generateExpr(value, output, 0);
+        output.emit(Opcode::STM, Operand::reg(0), Operand::address(location.slot));
+    }
+    else
+    {
+        generateExpr(value, output, location.reg);
     }
-    return variableToRegister[name];
 }
 
-std::vector<std::string> CodeGenerator::generate(const std::vector<std::unique_ptr<Stmt>> &statements)
+InstructionBuffer CodeGenerator::generate(const std::vector<std::unique_ptr<Stmt>> &statements)
 {
-    std::vector<std::string> output;
+    InstructionBuffer output;
+
+    RegisterAllocator allocator(FIRST_VARIABLE_REGISTER, LAST_VARIABLE_REGISTER, VM_MEMORY_SIZE - SCRATCH_SAVE_SLOTS);
+    variableLocations = allocator.allocate(statements);
+
+    temporaries = {6, 7};
+    for (int reg = FIRST_VARIABLE_REGISTER; reg <= LAST_VARIABLE_REGISTER; ++reg)
+    {
+        bool used = false;
+        for (const auto &entry : variableLocations)
+            used = used || entry.second.reg == reg;
+        if (!used)
+            temporaries.push_back(reg);
+    }
+    freeTemporaries.assign(temporaries.rbegin(), temporaries.rend());
+    borrowedTemporaries = 0;
+    registerNeeds.clear();
 
     for (const auto &stmt : statements)
     {
         generateStmt(stmt.get(), output);
     }
 
-    for (const auto &entry : stringTable)
+    for (size_t id = 0; id < output.stringCount(); ++id)
     {
-        output.push_back("DATA " + entry.second + " \"" + entry.first + "\"");
+        output.emit(Opcode::DATA, Operand::string(static_cast<int>(id)));
     }
 
-    output.push_back("HALT");
+    output.emit(Opcode::HALT);
     return output;
 }
 
-void CodeGenerator::generateStmt(Stmt *stmt, std::vector<std::string> &output)
+void CodeGenerator::generateStmt(Stmt *stmt, InstructionBuffer &output)
 {
     if (stmt->type == StmtType::VAR_DECL)
     {
         auto *decl = static_cast<VarDeclStmt *>(stmt);
-        std::string reg = getRegisterForVariable(decl->varName);
-        generateExpr(decl->initializer.get(), output, reg);
+        storeVariable(decl->varName, decl->initializer.get(), output);
     }
     else if (stmt->type == StmtType::ASSIGN)
     {
         auto *assign = static_cast<AssignStmt *>(stmt);
-        std::string reg = getRegisterForVariable(assign->varName);
-        generateExpr(assign->value.get(), output, reg);
+        storeVariable(assign->varName, assign->value.get(), output);
     }
     else if (stmt->type == StmtType::IF)
     {
-        auto *ifStmt = static_cast<IfStmt *>(stmt);
-
-        std::string endLabel = newLabel("endif");
+        int endLabel = newLabel("endif", output);
+        generateIf(static_cast<IfStmt *>(stmt), endLabel, output);
+        output.emit(Opcode::LABEL, Operand::label(endLabel));
+    }
 
-        // Label generator
-        auto nextBlockLabel = newLabel("else");
+    else if (stmt->type == StmtType::WHILE)
+    {
+        auto *loop = static_cast<WhileStmt *>(stmt);
+        int startLabel = newLabel("while", output);
+        int endLabel = newLabel("endwhile", output);
 
-        // Evaluate the main `if` condition
-        generateExpr(ifStmt->condition.get(), output, "R0");
-        output.push_back("CMP R0, 0");
-        output.push_back("JE " + nextBlockLabel);
+        output.emit(Opcode::LABEL, Operand::label(startLabel));
+        generateCondition(loop->condition.get(), endLabel, output);
 
-        // then block
-        for (const auto &s : ifStmt->thenBranch)
+        for (const auto &s : loop->body)
         {
             generateStmt(s.get(), output);
         }
-        output.push_back("JMP " + endLabel);
 
-        output.push_back("LABEL " + nextBlockLabel);
+        output.emit(Opcode::JMP, Operand::label(startLabel));
+        output.emit(Opcode::LABEL, Operand::label(endLabel));
+    }
+    if (stmt->type == StmtType::PRINT)
+    {
+        auto *printStmt = static_cast<PrintStmt *>(stmt);
 
-        // else-if (recursively nested IfStmt)
-        if (ifStmt->elseIfStmt)
+        if (printStmt->expression->type == ExprType::STRING_LITERAL)
         {
-            generateStmt(ifStmt->elseIfStmt.get(), output);
+            auto *strExpr = static_cast<StringLiteralExpr *>(printStmt->expression.get());
+            output.emit(Opcode::PRINTS, Operand::string(output.string(strExpr->value)));
         }
-        // else block
-        else if (!ifStmt->elseBranch.empty())
+        else
         {
-            for (const auto &s : ifStmt->elseBranch)
-            {
-                generateStmt(s.get(), output);
-            }
+            generateExpr(printStmt->expression.get(), output, 0);
+            output.emit(Opcode::PRINT, Operand::reg(0));
         }
+    }
+}
+
+// Plain register variables are read in place
+int CodeGenerator::registerOf(Expr *expr)
+{
+    if (expr->type != ExprType::VARIABLE)
+        return -1;
+    return getLocationForVariable(static_cast<VariableExpr *>(expr)->name).reg;
+}
+
+static bool isComparison(const std::string &op)
+{
+    return op == "==" || op == "!=" || op == "<" || op == "<=" || op == ">" || op == ">=";
+}
+
+static bool containsComparison(Expr *expr)
+{
+    if (expr->type != ExprType::BINARY)
+        return false;
+    auto *bin = static_cast<BinaryExpr *>(expr);
+    return isComparison(bin->op) || containsComparison(bin->left.get()) || containsComparison(bin->right.get());
+}
 
-        output.push_back("LABEL " + endLabel);
+// Sethi-Ullman number: registers needed to evaluate expr, counting the target
+int CodeGenerator::registerNeed(Expr *expr)
+{
+    if (expr->type != ExprType::BINARY)
+        return 1;
+
+    auto it = registerNeeds.find(expr);
+    if (it != registerNeeds.end())
+        return it->second;
+
+    auto *bin = static_cast<BinaryExpr *>(expr);
+    int immediate = 0;
+    int need;
+    if (getImmediate(bin->right.get(), immediate) || registerOf(bin->right.get()) >= 0)
+        need = registerNeed(bin->left.get());
+    else if (getImmediate(bin->left.get(), immediate) || registerOf(bin->left.get()) >= 0)
+        need = registerNeed(bin->right.get());
+    else
+    {
+        int left = registerNeed(bin->left.get());
+        int right = registerNeed(bin->right.get());
+        need = left == right ? left + 1 : std::max(left, right);
     }
+    registerNeeds[expr] = need;
+    return need;
+}
 
-    else if (stmt->type == StmtType::WHILE)
+bool CodeGenerator::readsRegister(Expr *expr, int reg)
+{
+    if (expr->type == ExprType::VARIABLE)
+        return registerOf(expr) == reg;
+    if (expr->type != ExprType::BINARY)
+        return false;
+    auto *bin = static_cast<BinaryExpr *>(expr);
+    return readsRegister(bin->left.get(), reg) || readsRegister(bin->right.get(), reg);
+}
+
+// Runs body with a temporary other than avoid. When none is free, one in
+// use further up the expression is saved to memory and restored afterwards.
+void CodeGenerator::withScratch(InstructionBuffer &output, int avoid, const std::function<void(int)> &body)
+{
+    for (size_t i = freeTemporaries.size(); i-- > 0;)
     {
-        auto *loop = static_cast<WhileStmt *>(stmt);
-        std::string startLabel = newLabel("while");
-        std::string endLabel = newLabel("endwhile");
-        std::string condReg = "R0";
+        if (freeTemporaries[i] == avoid)
+            continue;
+        int scratch = freeTemporaries[i];
+        freeTemporaries.erase(freeTemporaries.begin() + i);
+        body(scratch);
+        freeTemporaries.push_back(scratch);
+        return;
+    }
 
-        output.push_back("LABEL " + startLabel);
-        generateExpr(loop->condition.get(), output, condReg);
-        output.push_back("CMP " + condReg + ", 0");
-        output.push_back("JE " + endLabel);
+    if (borrowedTemporaries == SCRATCH_SAVE_SLOTS)
+        throw std::runtime_error("Expression is nested too deeply");
+    int scratch = temporaries[0] == avoid ? temporaries[1] : temporaries[0];
+    int slot = VM_MEMORY_SIZE - 1 - borrowedTemporaries++;
+    output.emit(Opcode::STM, Operand::reg(scratch), Operand::address(slot));
+    body(scratch);
+    output.emit(Opcode::LDM, Operand::reg(scratch), Operand::address(slot));
+    --borrowedTemporaries;
+}
 
-        for (const auto &s : loop->body)
+void CodeGenerator::emitSetCompare(const std::string &op, int targetReg, InstructionBuffer &output)
+{
+    static const std::unordered_map<std::string, Opcode> jumps = {
+        {"==", Opcode::JE}, {"!=", Opcode::JNE}, {"<", Opcode::JLT}, {"<=", Opcode::JLE}, {">", Opcode::JGT}, {">=", Opcode::JGE}};
+
+    int labelTrue = newLabel("cmp_true", output);
+    int labelEnd = newLabel("cmp_end", output);
+
+    output.emit(jumps.at(op), Operand::label(labelTrue));
+    output.emit(Opcode::LOAD, Operand::reg(targetReg), Operand::imm(0));
+    output.emit(Opcode::JMP, Operand::label(labelEnd));
+    output.emit(Opcode::LABEL, Operand::label(labelTrue));
+    output.emit(Opcode::LOAD, Operand::reg(targetReg), Operand::imm(1));
+    output.emit(Opcode::LABEL, Operand::label(labelEnd));
+}
+
+// Every arm of an else-if chain jumps straight to the chain's shared end label
+void CodeGenerator::generateIf(IfStmt *ifStmt, int endLabel, InstructionBuffer &output)
+{
+    bool hasElse = ifStmt->elseIfStmt || !ifStmt->elseBranch.empty();
+    int elseLabel = hasElse ? newLabel("else", output) : endLabel;
+
+    generateCondition(ifStmt->condition.get(), elseLabel, output);
+    for (const auto &s : ifStmt->thenBranch)
+    {
+        generateStmt(s.get(), output);
+    }
+    if (!hasElse)
+        return;
+
+    output.emit(Opcode::JMP, Operand::label(endLabel));
+    output.emit(Opcode::LABEL, Operand::label(elseLabel));
+
+    if (ifStmt->elseIfStmt)
+    {
+        generateIf(ifStmt->elseIfStmt.get(), endLabel, output);
+    }
+    else
+    {
+        for (const auto &s : ifStmt->elseBranch)
         {
             generateStmt(s.get(), output);
         }
+    }
+}
 
-        output.push_back("JMP " + startLabel);
-        output.push_back("LABEL " + endLabel);
+// Branches to falseLabel when condition is false. A comparison sets the
+// flags directly and is followed by the inverted jump, skipping the 0/1
+// value a comparison produces in expression context.
+void CodeGenerator::generateCondition(Expr *condition, int falseLabel, InstructionBuffer &output)
+{
+    static const std::unordered_map<std::string, Opcode> invertedJumps = {
+        {"==", Opcode::JNE}, {"!=", Opcode::JE}, {"<", Opcode::JGE}, {"<=", Opcode::JGT}, {">", Opcode::JLE}, {">=", Opcode::JLT}};
+
+    if (condition->type == ExprType::BINARY && isComparison(static_cast<BinaryExpr *>(condition)->op))
+    {
+        std::string op = generateCompare(static_cast<BinaryExpr *>(condition), 0, output);
+        output.emit(invertedJumps.at(op), Operand::label(falseLabel));
+        return;
     }
-    if (stmt->type == StmtType::PRINT)
+
+    // A literal condition either always falls through or always jumps
+    if (condition->type == ExprType::LITERAL)
     {
-        auto *printStmt = static_cast<PrintStmt *>(stmt);
+        const std::string &value = static_cast<LiteralExpr *>(condition)->value;
+        if (value == "false" || value == "0")
+            output.emit(Opcode::JMP, Operand::label(falseLabel));
+        return;
+    }
 
-        if (printStmt->expression->type == ExprType::STRING_LITERAL)
-        {
-            auto *strExpr = static_cast<StringLiteralExpr *>(printStmt->expression.get());
-            std::string label = getStringLabel(strExpr->value);
-            output.push_back("PRINTS " + label);
-        }
-        else
-        {
-            generateExpr(printStmt->expression.get(), output, "R0");
-            output.push_back("PRINT R0");
-        }
+    int reg = registerOf(condition);
+    if (reg < 0)
+    {
+        generateExpr(condition, output, 0);
+        reg = 0;
     }
+    output.emit(Opcode::CMPI, Operand::reg(reg), Operand::imm(0));
+    output.emit(Opcode::JE, Operand::label(falseLabel));
 }
 
-void CodeGenerator::generateExpr(Expr *expr, std::vector<std::string> &output, const std::string &targetReg)
+void CodeGenerator::generateExpr(Expr *expr, InstructionBuffer &output, int targetReg)
 {
     if (expr->type == ExprType::LITERAL)
     {
         auto *lit = static_cast<LiteralExpr *>(expr);
-        output.push_back("LOAD " + targetReg + ", " + lit->value);
+        output.emit(Opcode::LOAD, Operand::reg(targetReg), Operand::imm(literalValue(lit->value)));
     }
     else if (expr->type == ExprType::VARIABLE)
     {
         auto *var = static_cast<VariableExpr *>(expr);
-        std::string reg = getRegisterForVariable(var->name);
-        output.push_back("MOV " + targetReg + ", " + reg);
+        const VariableLocation &location = getLocationForVariable(var->name);
+        if (location.spilled())
+            output.emit(Opcode::LDM, Operand::reg(targetReg), Operand::address(location.slot));
+        else if (location.reg != targetReg)
+            output.emit(Opcode::MOV, Operand::reg(targetReg), Operand::reg(location.reg));
     }
     else if (expr->type == ExprType::BINARY)
     {
-        auto *bin = static_cast<BinaryExpr *>(expr);
+        generateBinary(static_cast<BinaryExpr *>(expr), output, targetReg);
+    }
+}
+
+// Emits the CMP or CMPI for a comparison, using workReg to evaluate an
+// operand that is not already in a register. Returns the comparison that
+// the flags answer, which is mirrored when the literal was on the left.
+std::string CodeGenerator::generateCompare(BinaryExpr *bin, int workReg, InstructionBuffer &output)
+{
+    Expr *left = bin->left.get();
+    Expr *right = bin->right.get();
 
-        std::string leftReg = "R6";
-        std::string rightReg = "R7";
-        generateExpr(bin->left.get(), output, leftReg);
-        generateExpr(bin->right.get(), output, rightReg);
+    int immediate = 0;
+    Expr *operand = nullptr;
+    std::string op = bin->op;
+    if (getImmediate(right, immediate))
+    {
+        operand = left;
+    }
+    else if (getImmediate(left, immediate))
+    {
+        operand = right;
+        op = mirrorComparison(op);
+    }
 
-        if (bin->op == "+")
-        {
-            output.push_back("MOV " + targetReg + ", " + leftReg);
-            output.push_back("ADD " + targetReg + ", " + rightReg);
-        }
-        else if (bin->op == "-")
+    if (operand)
+    {
+        int operandReg = registerOf(operand);
+        if (operandReg < 0)
         {
-            output.push_back("MOV " + targetReg + ", " + leftReg);
-            output.push_back("SUB " + targetReg + ", " + rightReg);
+            generateExpr(operand, output, workReg);
+            operandReg = workReg;
         }
-        else if (bin->op == "*")
+        output.emit(Opcode::CMPI, Operand::reg(operandReg), Operand::imm(immediate));
+        return op;
+    }
+
+    int leftReg = registerOf(left);
+    int rightReg = registerOf(right);
+
+    // Whichever operand is evaluated second goes straight into workReg
+    if (leftReg < 0 && rightReg < 0)
+    {
+        bool rightFirst = registerNeed(right) > registerNeed(left);
+        Expr *first = rightFirst ? right : left;
+        Expr *second = rightFirst ? left : right;
+        withScratch(output, workReg, [&](int scratch)
+                    {
+            generateExpr(first, output, scratch);
+            generateExpr(second, output, workReg);
+            if (rightFirst)
+                output.emit(Opcode::CMP, Operand::reg(workReg), Operand::reg(scratch));
+            else
+                output.emit(Opcode::CMP, Operand::reg(scratch), Operand::reg(workReg)); });
+    }
+    else if (leftReg < 0 || rightReg < 0)
+    {
+        int &missing = leftReg < 0 ? leftReg : rightReg;
+        Expr *pending = leftReg < 0 ? left : right;
+        if ((leftReg < 0 ? rightReg : leftReg) == workReg)
         {
-            output.push_back("MOV " + targetReg + ", " + leftReg);
-            output.push_back("MUL " + targetReg + ", " + rightReg);
+            withScratch(output, workReg, [&](int scratch)
+                        {
+                generateExpr(pending, output, scratch);
+                missing = scratch;
+                output.emit(Opcode::CMP, Operand::reg(leftReg), Operand::reg(rightReg)); });
         }
-        else if (bin->op == "/")
+        else
         {
-            output.push_back("MOV " + targetReg + ", " + leftReg);
-            output.push_back("DIV " + targetReg + ", " + rightReg);
+            generateExpr(pending, output, workReg);
+            missing = workReg;
+            output.emit(Opcode::CMP, Operand::reg(leftReg), Operand::reg(rightReg));
         }
-        else if (bin->op == "==" || bin->op == "!=" ||
-                 bin->op == "<" || bin->op == "<=" ||
-                 bin->op == ">" || bin->op == ">=")
+    }
+    else
+    {
+        output.emit(Opcode::CMP, Operand::reg(leftReg), Operand::reg(rightReg));
+    }
+    return op;
+}
+
+// Computes bin into targetReg, which may be overwritten before the operands
+// are consumed only when they no longer need its old value. R0 is also
+// clobbered by every comparison, so it never holds a value across one.
+void CodeGenerator::generateBinary(BinaryExpr *bin, InstructionBuffer &output, int targetReg)
+{
+    static const std::unordered_map<std::string, Opcode> registerOps = {
+        {"+", Opcode::ADD}, {"-", Opcode::SUB}, {"*", Opcode::MUL}, {"/", Opcode::DIV}};
+    static const std::unordered_map<std::string, Opcode> immediateOps = {
+        {"+", Opcode::ADDI}, {"-", Opcode::SUBI}, {"*", Opcode::MULI}, {"/", Opcode::DIVI}};
+
+    if (isComparison(bin->op))
+    {
+        std::string op = generateCompare(bin, targetReg, output);
+        emitSetCompare(op, targetReg, output);
+        return;
+    }
+
+    bool commutative = bin->op == "+" || bin->op == "*";
+    Expr *left = bin->left.get();
+    Expr *right = bin->right.get();
+    Opcode opcode = registerOps.at(bin->op);
+
+    // Register-immediate forms when one side is a small literal
+    int immediate = 0;
+    Expr *operand = nullptr;
+    if (getImmediate(right, immediate))
+        operand = left;
+    else if (commutative && getImmediate(left, immediate))
+        operand = right;
+
+    if (operand)
+    {
+        generateExpr(operand, output, targetReg);
+        output.emit(immediateOps.at(bin->op), Operand::reg(targetReg), Operand::imm(immediate));
+        return;
+    }
+
+    int leftReg = registerOf(left);
+    int rightReg = registerOf(right);
+    bool rightFirst = registerNeed(right) > registerNeed(left);
+
+    if (rightReg >= 0 && rightReg != targetReg)
+    {
+        generateExpr(left, output, targetReg);
+        output.emit(opcode, Operand::reg(targetReg), Operand::reg(rightReg));
+    }
+    else if (leftReg == targetReg)
+    {
+        // target op= right; the target keeps its value while right is evaluated
+        if (rightReg >= 0)
         {
-            output.push_back("CMP " + leftReg + ", " + rightReg);
-            std::string setReg = targetReg;
-
-            std::string labelTrue = newLabel("cmp_true");
-            std::string labelEnd = newLabel("cmp_end");
-
-            std::string jmpInstr;
-            if (bin->op == "==")
-                jmpInstr = "JE";
-            else if (bin->op == "!=")
-                jmpInstr = "JNE";
-            else if (bin->op == "<")
-                jmpInstr = "JLT";
-            else if (bin->op == "<=")
-                jmpInstr = "JLE";
-            else if (bin->op == ">")
-                jmpInstr = "JGT";
-            else if (bin->op == ">=")
-                jmpInstr = "JGE";
-
-            output.push_back(jmpInstr + " " + labelTrue);
-            output.push_back("LOAD " + setReg + ", 0");
-            output.push_back("JMP " + labelEnd);
-            output.push_back("LABEL " + labelTrue);
-            output.push_back("LOAD " + setReg + ", 1");
-            output.push_back("LABEL " + labelEnd);
+            output.emit(opcode, Operand::reg(targetReg), Operand::reg(rightReg));
+            return;
         }
+        withScratch(output, targetReg, [&](int scratch)
+                    {
+            generateExpr(right, output, scratch);
+            output.emit(opcode, Operand::reg(targetReg), Operand::reg(scratch)); });
+    }
+    else if (commutative && leftReg >= 0)
+    {
+        generateExpr(right, output, targetReg);
+        output.emit(opcode, Operand::reg(targetReg), Operand::reg(leftReg));
+    }
+    else
+    {
+        // The heavier side goes first. Evaluating left straight into the
+        // target is only safe when right does not read the target after.
+        bool leftIntoTarget = !rightFirst && !commutative && !readsRegister(right, targetReg) &&
+                              !(targetReg == 0 && containsComparison(right));
+        withScratch(output, targetReg, [&](int scratch)
+                    {
+            if (leftIntoTarget)
+            {
+                generateExpr(left, output, targetReg);
+                generateExpr(right, output, scratch);
+            }
+            else if (commutative && !rightFirst)
+            {
+                generateExpr(left, output, scratch);
+                generateExpr(right, output, targetReg);
+            }
+            else
+            {
+                generateExpr(right, output, scratch);
+                generateExpr(left, output, targetReg);
+            }
+            output.emit(opcode, Operand::reg(targetReg), Operand::reg(scratch)); });
     }
 }
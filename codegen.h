@@ -2,6 +2,9 @@
 #define CODEGEN_H
 
 #include "ast.h"
+#include "instruction.h"
+#include "regalloc.h"
+#include <functional>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -10,32 +13,36 @@ class CodeGenerator
 {
 public:
     CodeGenerator();
-    std::vector<std::string> generate(const std::vector<std::unique_ptr<Stmt>> &statements);
+    InstructionBuffer generate(const std::vector<std::unique_ptr<Stmt>> &statements);
 
 private:
-    std::unordered_map<std::string, std::string> variableToRegister;
-
-    std::unordered_map<std::string, std::string> stringTable;
-    int stringCounter = 0;
-
-    // Returns label like "str_0", "str_1", etc.
-    std::string getStringLabel(const std::string &str)
-    {
-        if (stringTable.find(str) == stringTable.end())
-        {
-            stringTable[str] = "str_" + std::to_string(stringCounter++);
-        }
-        return stringTable[str];
-    }
-
-    int registerCounter;
-    int labelCounter;
+    std::unordered_map<std::string, VariableLocation> variableLocations;
 
-    std::string newLabel(const std::string &base);
-    std::string getRegisterForVariable(const std::string &name);
+    int labelCounter;
 
-    void generateStmt(Stmt *stmt, std::vector<std::string> &output);
-    void generateExpr(Expr *expr, std::vector<std::string> &output, const std::string &targetReg);
+    // Expression temporaries: R6, R7 and any variable register the
+    // allocator left unused
+    std::vector<int> temporaries;
+    std::vector<int> freeTemporaries;
+    int borrowedTemporaries = 0;
+    std::unordered_map<Expr *, int> registerNeeds; // Sethi-Ullman labels
+
+    int newLabel(const std::string &base, InstructionBuffer &output);
+    const VariableLocation &getLocationForVariable(const std::string &name);
+    void storeVariable(const std::string &name, Expr *value, InstructionBuffer &output);
+
+    void generateStmt(Stmt *stmt, InstructionBuffer &output);
+    void generateIf(IfStmt *ifStmt, int endLabel, InstructionBuffer &output);
+    void generateCondition(Expr *condition, int falseLabel, InstructionBuffer &output);
+    void generateExpr(Expr *expr, InstructionBuffer &output, int targetReg);
+    void generateBinary(BinaryExpr *bin, InstructionBuffer &output, int targetReg);
+    std::string generateCompare(BinaryExpr *bin, int workReg, InstructionBuffer &output);
+    void emitSetCompare(const std::string &op, int targetReg, InstructionBuffer &output);
+
+    int registerOf(Expr *expr); // -1 when not in a register
+    int registerNeed(Expr *expr);
+    bool readsRegister(Expr *expr, int reg);
+    void withScratch(InstructionBuffer &output, int avoid, const std::function<void(int)> &body);
 };
 
 #endif
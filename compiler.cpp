@@ -0,0 +1,66 @@
+#include "compiler.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "codegen.h"
+#include "constfold.h"
+#include "deadcode.h"
+#include "irbuilder.h"
+#include "irlower.h"
+#include "licm.h"
+#include "strength.h"
+#include "unroll.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+std::string readFile(const std::string &filename)
+{
+    std::ifstream inFile(filename);
+    if (!inFile)
+        throw std::runtime_error("Could not open source file: " + filename);
+
+    std::stringstream buffer;
+    buffer << inFile.rdbuf();
+    return buffer.str();
+}
+
+bool hasSBSuffix(const std::string &filename)
+{
+    return filename.size() >= 3 && filename.substr(filename.size() - 3) == ".sb";
+}
+
+InstructionBuffer compileSource(const std::string &source, const CompileOptions &options)
+{
+    Tokenizer tokenizer(source);
+    std::vector<Token> tokens = tokenizer.tokenize();
+
+    Parser parser(tokens);
+    std::vector<std::unique_ptr<Stmt>> ast = parser.parse();
+    if (options.optimizationLevel < 1)
+    {
+        CodeGenerator generator;
+        return generator.generate(ast);
+    }
+
+    ConstantFolder().run(ast);
+    DeadCodeEliminator().run(ast);
+    if (LoopUnroller(options.unrollFactor).run(ast))
+    {
+        ConstantFolder().run(ast);
+        DeadCodeEliminator().run(ast);
+    }
+
+    IrFunction ir = IrBuilder().build(ast);
+    LoopInvariantMotion().run(ir);
+    StrengthReduction().run(ir);
+    ir.verify();
+    if (options.irDump)
+        ir.dump(*options.irDump);
+    InstructionBuffer program = IrLowering().lower(std::move(ir));
+
+    PeepholeOptimizer peephole;
+    program = peephole.optimize(std::move(program));
+    if (options.peepholeStats)
+        options.peepholeStats->add(peephole.stats());
+    return program;
+}
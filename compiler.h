@@ -0,0 +1,35 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "peephole.h"
+#include "unroll.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Bump whenever the same source and options may compile to different
+// bytecode, which invalidates every CompileCache entry
+const uint32_t COMPILER_VERSION = 3;
+
+// Reads a whole source file into memory
+std::string readFile(const std::string& filename);
+
+bool hasSBSuffix(const std::string& filename);
+
+struct CompileOptions {
+    int optimizationLevel = 1;
+    int unrollFactor = LoopUnroller::DEFAULT_FACTOR; // 1 turns unrolling off
+    PeepholeStats* peepholeStats = nullptr; // receives the peephole rule hits
+    std::ostream* irDump = nullptr;         // receives the IR at level 1
+};
+
+// Tokenizes, parses and generates instructions for Ion source text. Level 0
+// generates them straight from the AST. Level 1 folds constants and
+// removes dead code in the AST, unrolls counted loops, lowers it to SSA
+// IR, hoists loop-invariant code there and lowers the IR to instructions,
+// then runs the peephole pass. Touches no files, so it is safe to call
+// from several threads at once.
+InstructionBuffer compileSource(const std::string& source, const CompileOptions& options = {});
+
+#endif
@@ -0,0 +1,191 @@
+#include "constfold.h"
+#include <climits>
+#include <cstdint>
+#include <unordered_set>
+
+static bool literalValue(const Expr *expr, int &value)
+{
+    if (expr->type != ExprType::LITERAL)
+        return false;
+
+    const std::string &text = static_cast<const LiteralExpr *>(expr)->value;
+    if (text == "true" || text == "false")
+        value = text == "true" ? 1 : 0;
+    else
+        value = static_cast<int>(static_cast<uint32_t>(std::stoll(text)));
+    return true;
+}
+
+static int wrap(int64_t value)
+{
+    return static_cast<int>(static_cast<uint32_t>(value));
+}
+
+static bool evaluate(const std::string &op, int left, int right, int &result)
+{
+    if (op == "+")
+        result = wrap(static_cast<int64_t>(left) + right);
+    else if (op == "-")
+        result = wrap(static_cast<int64_t>(left) - right);
+    else if (op == "*")
+        result = wrap(static_cast<int64_t>(left) * right);
+    else if (op == "/")
+    {
+        if (right == 0)
+            return false;
+        result = left == INT_MIN && right == -1 ? INT_MIN : left / right;
+    }
+    else if (op == "==")
+        result = left == right;
+    else if (op == "!=")
+        result = left != right;
+    else if (op == "<")
+        result = left < right;
+    else if (op == "<=")
+        result = left <= right;
+    else if (op == ">")
+        result = left > right;
+    else if (op == ">=")
+        result = left >= right;
+    else
+        return false;
+    return true;
+}
+
+static void collectAssigned(const std::vector<std::unique_ptr<Stmt>> &block, std::unordered_set<std::string> &names);
+
+static void collectAssigned(Stmt *stmt, std::unordered_set<std::string> &names)
+{
+    if (stmt->type == StmtType::VAR_DECL)
+        names.insert(static_cast<VarDeclStmt *>(stmt)->varName);
+    else if (stmt->type == StmtType::ASSIGN)
+        names.insert(static_cast<AssignStmt *>(stmt)->varName);
+    else if (stmt->type == StmtType::WHILE)
+        collectAssigned(static_cast<WhileStmt *>(stmt)->body, names);
+    else if (stmt->type == StmtType::IF)
+    {
+        auto *ifStmt = static_cast<IfStmt *>(stmt);
+        collectAssigned(ifStmt->thenBranch, names);
+        collectAssigned(ifStmt->elseBranch, names);
+        if (ifStmt->elseIfStmt)
+            collectAssigned(ifStmt->elseIfStmt.get(), names);
+    }
+}
+
+static void collectAssigned(const std::vector<std::unique_ptr<Stmt>> &block, std::unordered_set<std::string> &names)
+{
+    for (const auto &stmt : block)
+        collectAssigned(stmt.get(), names);
+}
+
+void ConstantFolder::run(std::vector<std::unique_ptr<Stmt>> &program)
+{
+    Constants known;
+    foldBlock(program, known);
+}
+
+void ConstantFolder::foldBlock(std::vector<std::unique_ptr<Stmt>> &block, Constants &known)
+{
+    for (auto &stmt : block)
+        foldStmt(stmt.get(), known);
+}
+
+void ConstantFolder::foldStmt(Stmt *stmt, Constants &known)
+{
+    if (stmt->type == StmtType::VAR_DECL)
+    {
+        auto *decl = static_cast<VarDeclStmt *>(stmt);
+        foldExpr(decl->initializer, known);
+        assign(decl->varName, decl->initializer.get(), known);
+    }
+    else if (stmt->type == StmtType::ASSIGN)
+    {
+        auto *assignment = static_cast<AssignStmt *>(stmt);
+        foldExpr(assignment->value, known);
+        assign(assignment->varName, assignment->value.get(), known);
+    }
+    else if (stmt->type == StmtType::PRINT)
+    {
+        foldExpr(static_cast<PrintStmt *>(stmt)->expression, known);
+    }
+    else if (stmt->type == StmtType::IF)
+    {
+        foldIf(static_cast<IfStmt *>(stmt), known);
+    }
+    else if (stmt->type == StmtType::WHILE)
+    {
+        // The condition and body also run after a back edge, by which time
+        // anything the body assigns may have changed
+        auto *loop = static_cast<WhileStmt *>(stmt);
+        std::unordered_set<std::string> assigned;
+        collectAssigned(loop->body, assigned);
+        for (const std::string &name : assigned)
+            known.erase(name);
+
+        foldExpr(loop->condition, known);
+        Constants inside = known;
+        foldBlock(loop->body, inside);
+    }
+}
+
+void ConstantFolder::foldIf(IfStmt *ifStmt, Constants &known)
+{
+    foldExpr(ifStmt->condition, known);
+
+    Constants thenKnown = known;
+    foldBlock(ifStmt->thenBranch, thenKnown);
+
+    Constants elseKnown = known;
+    if (ifStmt->elseIfStmt)
+        foldIf(ifStmt->elseIfStmt.get(), elseKnown);
+    else
+        foldBlock(ifStmt->elseBranch, elseKnown);
+
+    int condition = 0;
+    if (literalValue(ifStmt->condition.get(), condition))
+    {
+        known = condition ? thenKnown : elseKnown;
+        return;
+    }
+
+    // Keep what both arms agree on
+    known.clear();
+    for (const auto &entry : thenKnown)
+    {
+        auto it = elseKnown.find(entry.first);
+        if (it != elseKnown.end() && it->second == entry.second)
+            known.insert(entry);
+    }
+}
+
+void ConstantFolder::foldExpr(std::unique_ptr<Expr> &expr, const Constants &known)
+{
+    if (expr->type == ExprType::VARIABLE)
+    {
+        auto it = known.find(static_cast<VariableExpr *>(expr.get())->name);
+        if (it != known.end())
+            expr = std::make_unique<LiteralExpr>(std::to_string(it->second));
+    }
+    else if (expr->type == ExprType::BINARY)
+    {
+        auto *bin = static_cast<BinaryExpr *>(expr.get());
+        foldExpr(bin->left, known);
+        foldExpr(bin->right, known);
+
+        int left = 0;
+        int right = 0;
+        int result = 0;
+        if (literalValue(bin->left.get(), left) && literalValue(bin->right.get(), right) &&
+            evaluate(bin->op, left, right, result))
+            expr = std::make_unique<LiteralExpr>(std::to_string(result));
+    }
+}
+
+void ConstantFolder::assign(const std::string &name, const Expr *value, Constants &known)
+{
+    int constant = 0;
+    if (literalValue(value, constant))
+        known[name] = constant;
+    else
+        known.erase(name);
+}
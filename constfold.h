@@ -0,0 +1,30 @@
+#ifndef CONSTFOLD_H
+#define CONSTFOLD_H
+
+#include "ast.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Folds BinaryExprs over literals and substitutes variables whose value is
+// known at that point. Knowledge flows forward through straight-line code;
+// an if keeps only the values its arms agree on, and a while forgets every
+// variable its body assigns before looking at the condition.
+// Arithmetic wraps at 32 bits like the VM. Division by a literal zero is
+// left in place so it still faults at run time.
+class ConstantFolder
+{
+public:
+    void run(std::vector<std::unique_ptr<Stmt>> &program);
+
+private:
+    using Constants = std::unordered_map<std::string, int>;
+
+    void foldBlock(std::vector<std::unique_ptr<Stmt>> &block, Constants &known);
+    void foldStmt(Stmt *stmt, Constants &known);
+    void foldIf(IfStmt *ifStmt, Constants &known);
+    void foldExpr(std::unique_ptr<Expr> &expr, const Constants &known);
+    void assign(const std::string &name, const Expr *value, Constants &known);
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include "deadcode.h"
+
+static bool literalValue(const Expr *expr, bool &nonZero)
+{
+    if (expr->type != ExprType::LITERAL)
+        return false;
+    const std::string &text = static_cast<const LiteralExpr *>(expr)->value;
+    nonZero = text != "false" && text != "0";
+    return true;
+}
+
+// Division by anything but a non-zero literal may fault, which is observable
+static bool canFault(const Expr *expr)
+{
+    if (expr->type != ExprType::BINARY)
+        return false;
+    auto *bin = static_cast<const BinaryExpr *>(expr);
+    bool nonZero = false;
+    if (bin->op == "/" && !(literalValue(bin->right.get(), nonZero) && nonZero))
+        return true;
+    return canFault(bin->left.get()) || canFault(bin->right.get());
+}
+
+static void addUses(const Expr *expr, std::set<std::string> &live)
+{
+    if (expr->type == ExprType::VARIABLE)
+    {
+        live.insert(static_cast<const VariableExpr *>(expr)->name);
+    }
+    else if (expr->type == ExprType::BINARY)
+    {
+        auto *bin = static_cast<const BinaryExpr *>(expr);
+        addUses(bin->left.get(), live);
+        addUses(bin->right.get(), live);
+    }
+}
+
+void DeadCodeEliminator::run(std::vector<std::unique_ptr<Stmt>> &program)
+{
+    // Dropping one assignment can leave the ones feeding it unread
+    do
+    {
+        changed = false;
+        pruneBranches(program);
+        sweep(program, Live(), true);
+    } while (changed);
+}
+
+void DeadCodeEliminator::pruneBranches(std::vector<std::unique_ptr<Stmt>> &block)
+{
+    std::vector<std::unique_ptr<Stmt>> pruned;
+    pruned.reserve(block.size());
+
+    for (auto &stmt : block)
+    {
+        bool condition = false;
+        if (stmt->type == StmtType::IF)
+        {
+            auto *ifStmt = static_cast<IfStmt *>(stmt.get());
+            if (literalValue(ifStmt->condition.get(), condition))
+            {
+                // Splice in the arm that runs; an else-if arm is itself pruned
+                std::vector<std::unique_ptr<Stmt>> taken;
+                if (condition)
+                    taken = std::move(ifStmt->thenBranch);
+                else if (ifStmt->elseIfStmt)
+                    taken.push_back(std::move(ifStmt->elseIfStmt));
+                else
+                    taken = std::move(ifStmt->elseBranch);
+
+                pruneBranches(taken);
+                for (auto &inner : taken)
+                    pruned.push_back(std::move(inner));
+                changed = true;
+                continue;
+            }
+
+            pruneBranches(ifStmt->thenBranch);
+            pruneBranches(ifStmt->elseBranch);
+            if (ifStmt->elseIfStmt)
+            {
+                std::vector<std::unique_ptr<Stmt>> elseBlock;
+                elseBlock.push_back(std::move(ifStmt->elseIfStmt));
+                pruneBranches(elseBlock);
+                if (elseBlock.size() == 1 && elseBlock[0]->type == StmtType::IF)
+                    ifStmt->elseIfStmt.reset(static_cast<IfStmt *>(elseBlock[0].release()));
+                else
+                    ifStmt->elseBranch = std::move(elseBlock);
+            }
+        }
+        else if (stmt->type == StmtType::WHILE)
+        {
+            auto *loop = static_cast<WhileStmt *>(stmt.get());
+            if (literalValue(loop->condition.get(), condition) && !condition)
+            {
+                changed = true;
+                continue;
+            }
+            pruneBranches(loop->body);
+        }
+        pruned.push_back(std::move(stmt));
+    }
+
+    block = std::move(pruned);
+}
+
+// Walks block backwards from the variables live after it and returns the
+// ones live before it. With remove set, statements found dead are erased.
+DeadCodeEliminator::Live DeadCodeEliminator::sweep(std::vector<std::unique_ptr<Stmt>> &block, Live live, bool remove)
+{
+    for (size_t i = block.size(); i-- > 0;)
+    {
+        bool dead = false;
+        live = sweepStmt(block[i].get(), std::move(live), remove, dead);
+        if (dead && remove)
+        {
+            block.erase(block.begin() + i);
+            changed = true;
+        }
+    }
+    return live;
+}
+
+DeadCodeEliminator::Live DeadCodeEliminator::sweepStmt(Stmt *stmt, Live live, bool remove, bool &dead)
+{
+    if (stmt->type == StmtType::VAR_DECL || stmt->type == StmtType::ASSIGN)
+    {
+        const std::string &name = stmt->type == StmtType::VAR_DECL ? static_cast<VarDeclStmt *>(stmt)->varName
+                                                                   : static_cast<AssignStmt *>(stmt)->varName;
+        const Expr *value = stmt->type == StmtType::VAR_DECL ? static_cast<VarDeclStmt *>(stmt)->initializer.get()
+                                                             : static_cast<AssignStmt *>(stmt)->value.get();
+        if (!live.count(name) && !canFault(value))
+        {
+            dead = true;
+            return live;
+        }
+        live.erase(name);
+        addUses(value, live);
+    }
+    else if (stmt->type == StmtType::PRINT)
+    {
+        addUses(static_cast<PrintStmt *>(stmt)->expression.get(), live);
+    }
+    else if (stmt->type == StmtType::IF)
+    {
+        auto *ifStmt = static_cast<IfStmt *>(stmt);
+        if (ifStmt->thenBranch.empty() && ifStmt->elseBranch.empty() && !ifStmt->elseIfStmt &&
+            !canFault(ifStmt->condition.get()))
+        {
+            dead = true;
+            return live;
+        }
+        live = sweepIf(ifStmt, live, remove);
+    }
+    else if (stmt->type == StmtType::WHILE)
+    {
+        // Variables live at the loop head: grow the set until the body adds nothing
+        auto *loop = static_cast<WhileStmt *>(stmt);
+        Live head = live;
+        addUses(loop->condition.get(), head);
+        while (true)
+        {
+            Live next = head;
+            Live body = sweep(loop->body, head, false);
+            next.insert(body.begin(), body.end());
+            if (next == head)
+                break;
+            head = std::move(next);
+        }
+        if (remove)
+            sweep(loop->body, head, true);
+        live = head;
+    }
+    return live;
+}
+
+DeadCodeEliminator::Live DeadCodeEliminator::sweepIf(IfStmt *ifStmt, const Live &live, bool remove)
+{
+    Live result = sweep(ifStmt->thenBranch, live, remove);
+    Live otherwise = ifStmt->elseIfStmt ? sweepIf(ifStmt->elseIfStmt.get(), live, remove)
+                                        : sweep(ifStmt->elseBranch, live, remove);
+    result.insert(otherwise.begin(), otherwise.end());
+    addUses(ifStmt->condition.get(), result);
+    return result;
+}
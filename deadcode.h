@@ -0,0 +1,31 @@
+#ifndef DEADCODE_H
+#define DEADCODE_H
+
+#include "ast.h"
+#include <set>
+#include <string>
+#include <vector>
+
+// Removes code whose effect is never observed, after ConstantFolder has
+// settled what conditions it can:
+//  - an if with a literal condition is replaced by the arm that runs
+//  - a while whose condition is literally false is dropped
+//  - an assignment is dropped when nothing reads the variable afterwards,
+//    unless evaluating it could fault (a division by a non-literal)
+class DeadCodeEliminator
+{
+public:
+    void run(std::vector<std::unique_ptr<Stmt>> &program);
+
+private:
+    using Live = std::set<std::string>;
+
+    bool changed = false;
+
+    void pruneBranches(std::vector<std::unique_ptr<Stmt>> &block);
+    Live sweep(std::vector<std::unique_ptr<Stmt>> &block, Live live, bool remove);
+    Live sweepStmt(Stmt *stmt, Live live, bool remove, bool &dead);
+    Live sweepIf(IfStmt *ifStmt, const Live &live, bool remove);
+};
+
+#endif
@@ -0,0 +1,485 @@
+#include "image.h"
+#include "bytecode.h"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+std::shared_ptr<const ProgramImage> ProgramImage::fromInstructions(const InstructionBuffer &program, bool fusion)
+{
+    auto image = std::make_shared<ProgramImage>();
+    image->decodeInstructions(program);
+    image->finalize(fusion);
+    return image;
+}
+
+std::shared_ptr<const ProgramImage> ProgramImage::fromAssembly(const std::vector<std::string> &program, bool fusion)
+{
+    return fromInstructions(InstructionBuffer::parse(program), fusion);
+}
+
+std::shared_ptr<const ProgramImage> ProgramImage::fromBinary(const std::vector<uint8_t> &bytes, bool fusion)
+{
+    auto image = std::make_shared<ProgramImage>();
+    image->decodeBinary(bytes);
+    image->finalize(fusion);
+    return image;
+}
+
+std::shared_ptr<const ProgramImage> ProgramImage::fromBinaryFile(const std::string &filename, bool fusion)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Could not open binary file: " + filename);
+
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return fromBinary(bytes, fusion);
+}
+
+static bool isJump(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::JMP:
+    case Opcode::JE:
+    case Opcode::JNE:
+    case Opcode::JLT:
+    case Opcode::JGT:
+    case Opcode::JLE:
+    case Opcode::JGE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void ProgramImage::decodeInstructions(const InstructionBuffer &program)
+{
+    // First pass: string table and label positions
+    std::vector<int> labelOffsets(program.labelCount(), -1);
+    std::vector<int> stringIds(program.stringCount(), -1);
+    int count = 0;
+    for (const Instruction &instr : program.code)
+    {
+        if (instr.opcode == Opcode::DATA)
+        {
+            stringIds[instr.a.value] = static_cast<int>(strings.size());
+            strings.push_back(program.stringText(instr.a.value));
+        }
+        else if (instr.opcode == Opcode::LABEL)
+        {
+            labelOffsets[instr.a.value] = count;
+            labels[program.labelName(instr.a.value)] = count;
+        }
+        else
+        {
+            ++count;
+        }
+    }
+
+    // Second pass: the remaining instructions, with labels and strings resolved
+    code.reserve(count);
+    for (const Instruction &instr : program.code)
+    {
+        if (instr.opcode == Opcode::DATA || instr.opcode == Opcode::LABEL)
+            continue;
+
+        DecodedInstruction decoded{instr.opcode, static_cast<uint8_t>(instr.a.value), instr.b.value, 0};
+        if (instr.opcode == Opcode::CMP && !instr.b.isRegister())
+            decoded.opcode = Opcode::CMPI;
+        if (isJump(instr.opcode))
+        {
+            decoded.dst = 0;
+            decoded.target = labelOffsets[instr.a.value];
+            if (decoded.target < 0)
+                throw std::runtime_error("Unknown label: " + program.labelName(instr.a.value));
+        }
+        else if (instr.opcode == Opcode::PRINTS)
+        {
+            decoded.dst = 0;
+            decoded.target = stringIds[instr.a.value];
+            if (decoded.target < 0)
+                throw std::runtime_error("Unknown string label: " + program.stringName(instr.a.value));
+        }
+        code.push_back(decoded);
+    }
+}
+
+void ProgramImage::decodeBinary(const std::vector<uint8_t> &bytes)
+{
+    if (!BytecodeFile::isVersion2(bytes))
+    {
+        decodeBinaryV1(bytes);
+        return;
+    }
+
+    BytecodeFile file = BytecodeFile::parse(bytes);
+    std::unordered_map<uint32_t, int> stringIds; // pool offset -> string id
+    for (const auto &entry : file.strings)
+    {
+        stringIds[entry.first] = static_cast<int>(strings.size());
+        strings.push_back(entry.second);
+    }
+
+    int64_t count = static_cast<int64_t>(file.code.size());
+    for (const auto &label : file.labelNames)
+    {
+        if (label.first <= count)
+            labels[label.second] = static_cast<int>(label.first);
+    }
+
+    code.reserve(file.code.size());
+    for (int64_t i = 0; i < count; ++i)
+    {
+        const BytecodeFile::Record &record = file.code[i];
+        DecodedInstruction instr{record.opcode, record.a, record.b, 0};
+        if (record.opcode == Opcode::LOAD || record.opcode == Opcode::LDM || record.opcode == Opcode::STM ||
+            hasImmediateOperand(record.opcode))
+            instr.src = record.operand;
+
+        if (isJump(record.opcode))
+        {
+            // A jump may land just past the last instruction, on END
+            int64_t target = i + 1 + record.operand;
+            if (target < 0 || target > count)
+                throw std::runtime_error("Jump target out of range at instruction " + std::to_string(i));
+            instr.dst = 0;
+            instr.target = static_cast<int32_t>(target);
+        }
+        else if (record.opcode == Opcode::PRINTS)
+        {
+            auto it = stringIds.find(static_cast<uint32_t>(record.operand));
+            if (it == stringIds.end())
+                throw std::runtime_error("Unknown string offset: " + std::to_string(record.operand));
+            instr.dst = 0;
+            instr.target = it->second;
+        }
+        code.push_back(instr);
+    }
+}
+
+// Version 1: 4-byte words with LABEL and DATA records inline, labels and
+// strings numbered with one byte
+void ProgramImage::decodeBinaryV1(const std::vector<uint8_t> &bytes)
+{
+    std::vector<int> labelOffsets; // label id -> index into code
+    size_t i = 0;
+    while (i + 3 < bytes.size())
+    {
+        uint8_t opcode = bytes[i];
+        uint8_t a1 = bytes[i + 1];
+        uint8_t a2 = bytes[i + 2];
+        uint8_t a3 = bytes[i + 3];
+        i += 4;
+
+        if (opcode == static_cast<uint8_t>(Opcode::DATA))
+        {
+            size_t len = a2;
+            if (i + len > bytes.size())
+                throw std::runtime_error("Truncated DATA record in program image");
+
+            if (strings.size() <= a1)
+                strings.resize(a1 + 1);
+            strings[a1].assign(reinterpret_cast<const char *>(&bytes[i]), len);
+
+            // DATA payload is padded to a 4-byte boundary
+            i += len + (4 - ((4 + len) % 4)) % 4;
+        }
+        else if (opcode == static_cast<uint8_t>(Opcode::LABEL))
+        {
+            if (labelOffsets.size() <= a1)
+                labelOffsets.resize(a1 + 1, -1);
+            labelOffsets[a1] = static_cast<int>(code.size());
+            labels["label_" + std::to_string(a1)] = static_cast<int>(code.size());
+        }
+        else
+        {
+            DecodedInstruction instr{static_cast<Opcode>(opcode), a1, a2, 0};
+            if (instr.opcode == Opcode::CMP && !(a3 & CMP_REGISTER_OPERAND))
+                instr.opcode = Opcode::CMPI;
+            if (hasImmediateOperand(instr.opcode))
+                instr.src = static_cast<int16_t>(a2 | (a3 << 8));
+            if (instr.opcode == Opcode::PRINTS)
+                instr.target = a1;
+            if (instr.opcode == Opcode::LDM || instr.opcode == Opcode::STM)
+                instr.src = a2 | (a3 << 8);
+            code.push_back(instr);
+        }
+    }
+
+    // Jump operands hold label ids until every LABEL record has been seen
+    for (DecodedInstruction &instr : code)
+    {
+        if (!isJump(instr.opcode))
+            continue;
+        if (instr.dst >= labelOffsets.size() || labelOffsets[instr.dst] < 0)
+            throw std::runtime_error("Unknown label id: " + std::to_string(instr.dst));
+        instr.target = labelOffsets[instr.dst];
+        instr.dst = 0;
+    }
+}
+
+// Checks operands once so the dispatch loop can index without checks, then
+// appends the END sentinel so falling off the last instruction needs no bounds test
+void ProgramImage::finalize(bool fusion)
+{
+    for (const DecodedInstruction &instr : code)
+    {
+        switch (instr.opcode)
+        {
+        case Opcode::LOAD:
+        case Opcode::ADDI:
+        case Opcode::SUBI:
+        case Opcode::MULI:
+        case Opcode::DIVI:
+        case Opcode::CMPI:
+        case Opcode::SHLI:
+        case Opcode::SHRI:
+        case Opcode::SARI:
+        case Opcode::ANDI:
+        case Opcode::PRINT:
+            if (instr.dst >= 8)
+                throw std::runtime_error("Register out of bounds: R" + std::to_string(instr.dst));
+            break;
+        case Opcode::MOV:
+        case Opcode::ADD:
+        case Opcode::SUB:
+        case Opcode::MUL:
+        case Opcode::DIV:
+        case Opcode::SHL:
+        case Opcode::SHR:
+        case Opcode::SAR:
+        case Opcode::AND:
+        case Opcode::CMP:
+            if (instr.dst >= 8 || instr.src < 0 || instr.src >= 8)
+                throw std::runtime_error("Register out of bounds: R" + std::to_string(instr.dst >= 8 ? instr.dst : instr.src));
+            break;
+        case Opcode::LDM:
+        case Opcode::STM:
+            if (instr.dst >= 8)
+                throw std::runtime_error("Register out of bounds: R" + std::to_string(instr.dst));
+            if (instr.src < 0 || instr.src >= VM_MEMORY_SIZE)
+                throw std::runtime_error("Memory address out of bounds: " + std::to_string(instr.src));
+            break;
+        case Opcode::PRINTS:
+            if (instr.target < 0 || instr.target >= static_cast<int>(strings.size()))
+                throw std::runtime_error("Unknown string id: " + std::to_string(instr.target));
+            break;
+        case Opcode::HALT:
+            break;
+        default:
+            if (!isJump(instr.opcode))
+                throw std::runtime_error("Unknown opcode: " + std::to_string(static_cast<int>(instr.opcode)));
+            break;
+        }
+    }
+
+    if (fusion)
+        fuseSuperinstructions();
+
+    code.push_back({Opcode::END, 0, 0, 0, 0}); // width 0: never charged to a budget
+    hash = computeHash();
+}
+
+// FNV-1a over the decoded records and string table, field by field so
+// struct padding never leaks into the result
+uint64_t ProgramImage::computeHash() const
+{
+    uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h](uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+        {
+            h ^= (value >> (8 * i)) & 0xFF;
+            h *= 1099511628211ULL;
+        }
+    };
+
+    mix(code.size(), 8);
+    for (const DecodedInstruction &instr : code)
+    {
+        mix(static_cast<uint8_t>(instr.opcode), 1);
+        mix(instr.dst, 1);
+        mix(static_cast<uint32_t>(instr.src), 4);
+        mix(static_cast<uint32_t>(instr.target), 4);
+        mix(instr.width, 1);
+    }
+
+    mix(strings.size(), 8);
+    for (const std::string &text : strings)
+    {
+        mix(text.size(), 8);
+        for (char c : text)
+            mix(static_cast<uint8_t>(c), 1);
+    }
+    return h;
+}
+
+int ProgramImage::instructionCount() const
+{
+    int count = 0;
+    for (const DecodedInstruction &instr : code)
+    {
+        if (instr.opcode != Opcode::END)
+            count += instr.width;
+    }
+    return count;
+}
+
+static Opcode setOpcodeFor(Opcode jump, bool immediate)
+{
+    switch (jump)
+    {
+    case Opcode::JE:
+        return immediate ? Opcode::SETEI : Opcode::SETE;
+    case Opcode::JNE:
+        return immediate ? Opcode::SETNEI : Opcode::SETNE;
+    case Opcode::JLT:
+        return immediate ? Opcode::SETLTI : Opcode::SETLT;
+    case Opcode::JGT:
+        return immediate ? Opcode::SETGTI : Opcode::SETGT;
+    case Opcode::JLE:
+        return immediate ? Opcode::SETLEI : Opcode::SETLE;
+    case Opcode::JGE:
+        return immediate ? Opcode::SETGEI : Opcode::SETGE;
+    default:
+        return Opcode::END;
+    }
+}
+
+// k when the records from start are the signed division of a by 2^k that
+// StrengthReduction emits, otherwise 0. For k = 1 the bias is a's sign bit
+// itself, so the leading SARI is left out.
+int ProgramImage::divisionShift(size_t start, const std::vector<int> &references) const
+{
+    const DecodedInstruction &mov = code[start];
+    if (start + 1 >= code.size() || mov.dst == mov.src)
+        return 0;
+    size_t length = code[start + 1].opcode == Opcode::SARI ? 5 : 4;
+    if (start + length > code.size())
+        return 0;
+    for (size_t k = 1; k < length; ++k)
+    {
+        if (references[start + k] != 0 || code[start + k].dst != mov.dst)
+            return 0;
+    }
+
+    const DecodedInstruction &sign = code[start + 1];
+    const DecodedInstruction &bias = code[start + length - 3];
+    const DecodedInstruction &add = code[start + length - 2];
+    const DecodedInstruction &sar = code[start + length - 1];
+    int shift = sar.src;
+    bool matches = bias.opcode == Opcode::SHRI && add.opcode == Opcode::ADD && add.src == mov.src &&
+                   sar.opcode == Opcode::SARI && shift >= 1 && shift <= 31 && bias.src == 32 - shift;
+    if (length == 5)
+        matches = matches && sign.src == 31;
+    else
+        matches = matches && shift == 1;
+    return matches ? shift : 0;
+}
+
+// Replaces the idioms the code generators emit with single records:
+//   MOV t, a / ADD|SUB|MUL|DIV t, b                    -> ADD3..DIV3 t, a, b
+//   CMPI r, 0 / JE L                                   -> CMPZ_JE r, L
+//   CMP a, b / Jcc T / LOAD t, 0 / JMP E / T: LOAD t, 1 -> SETcc t, a, b
+//   CMPI a, k / (same diamond)                         -> SETccI t, a, k
+//   MOV t, a / [SARI t, 31] / SHRI t, 32 - k / ADD t, a / SARI t, k
+//                                                      -> DIVP2 t, a, k
+// A sequence is only fused when no jump lands inside it.
+void ProgramImage::fuseSuperinstructions()
+{
+    const size_t n = code.size();
+
+    std::vector<int> references(n + 1, 0);
+    for (const DecodedInstruction &instr : code)
+    {
+        if (isJump(instr.opcode))
+            ++references[instr.target];
+    }
+
+    std::vector<DecodedInstruction> fused;
+    std::vector<int> newIndex(n + 1);
+    fused.reserve(n);
+
+    size_t i = 0;
+    while (i < n)
+    {
+        const DecodedInstruction &a = code[i];
+        DecodedInstruction out = a;
+        size_t length = 1;
+
+        int shift = a.opcode == Opcode::MOV ? divisionShift(i, references) : 0;
+        if (shift > 0)
+        {
+            out = {Opcode::DIVP2, a.dst, a.src, shift};
+            length = shift == 1 ? 4 : 5;
+        }
+        else if (a.opcode == Opcode::MOV && i + 1 < n && references[i + 1] == 0)
+        {
+            const DecodedInstruction &b = code[i + 1];
+            Opcode op = Opcode::END;
+            if (b.opcode == Opcode::ADD)
+                op = Opcode::ADD3;
+            else if (b.opcode == Opcode::SUB)
+                op = Opcode::SUB3;
+            else if (b.opcode == Opcode::MUL)
+                op = Opcode::MUL3;
+            else if (b.opcode == Opcode::DIV)
+                op = Opcode::DIV3;
+
+            if (op != Opcode::END && b.dst == a.dst)
+            {
+                // MOV t, a / ADD t, t reads the moved value as its second operand
+                int second = b.src == a.dst ? a.src : b.src;
+                out = {op, a.dst, a.src, second};
+                length = 2;
+            }
+        }
+        else if (a.opcode == Opcode::CMP || a.opcode == Opcode::CMPI)
+        {
+            // Prefer the whole diamond over its first two records
+            if (i + 4 < n)
+            {
+                const DecodedInstruction &jcc = code[i + 1];
+                const DecodedInstruction &load0 = code[i + 2];
+                const DecodedInstruction &jmp = code[i + 3];
+                const DecodedInstruction &load1 = code[i + 4];
+                Opcode op = setOpcodeFor(jcc.opcode, a.opcode == Opcode::CMPI);
+
+                if (op != Opcode::END &&
+                    jcc.target == static_cast<int>(i + 4) && references[i + 4] == 1 &&
+                    load0.opcode == Opcode::LOAD && load0.src == 0 &&
+                    jmp.opcode == Opcode::JMP && jmp.target == static_cast<int>(i + 5) &&
+                    load1.opcode == Opcode::LOAD && load1.src == 1 && load1.dst == load0.dst &&
+                    references[i + 1] == 0 && references[i + 2] == 0 && references[i + 3] == 0)
+                {
+                    out = {op, load0.dst, a.dst, a.src};
+                    length = 5;
+                }
+            }
+
+            if (length == 1 && a.opcode == Opcode::CMPI && a.src == 0 && i + 1 < n &&
+                references[i + 1] == 0 && code[i + 1].opcode == Opcode::JE)
+            {
+                out = {Opcode::CMPZ_JE, a.dst, 0, code[i + 1].target};
+                length = 2;
+            }
+        }
+
+        out.width = static_cast<uint8_t>(length);
+        for (size_t k = 0; k < length; ++k)
+            newIndex[i + k] = static_cast<int>(fused.size());
+        fused.push_back(out);
+        i += length;
+    }
+    newIndex[n] = static_cast<int>(fused.size());
+
+    for (DecodedInstruction &instr : fused)
+    {
+        if (isJump(instr.opcode) || instr.opcode == Opcode::CMPZ_JE)
+            instr.target = newIndex[instr.target];
+    }
+    for (auto &entry : labels)
+        entry.second = newIndex[entry.second];
+
+    code = std::move(fused);
+}
@@ -0,0 +1,51 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "instruction.h"
+#include "opcodes.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One instruction decoded at load time: registers are indices, immediates
+// are parsed, and jump targets / string labels are resolved to indices.
+struct DecodedInstruction {
+    Opcode opcode;
+    uint8_t dst;
+    int32_t src;    // source register or immediate
+    int32_t target; // instruction index for jumps, string id for PRINTS,
+                    // second source register for fused three-operand forms
+    uint8_t width = 1; // number of original instructions this record stands for
+};
+
+// A decoded program. Images are immutable once built, so one image can be
+// shared by any number of VirtualMachine instances and threads.
+class ProgramImage {
+public:
+    std::vector<DecodedInstruction> code; // ends with the END sentinel
+    std::vector<std::string> strings;     // string id -> text
+    std::unordered_map<std::string, int> labels; // label name -> index into code
+    uint64_t hash = 0; // identifies the decoded program, fusion included
+
+    static std::shared_ptr<const ProgramImage> fromInstructions(const InstructionBuffer& program, bool fusion = true);
+    // Parses program.asm text first
+    static std::shared_ptr<const ProgramImage> fromAssembly(const std::vector<std::string>& program, bool fusion = true);
+    static std::shared_ptr<const ProgramImage> fromBinary(const std::vector<uint8_t>& bytes, bool fusion = true);
+    static std::shared_ptr<const ProgramImage> fromBinaryFile(const std::string& filename, bool fusion = true);
+
+    // Number of original (unfused) instructions
+    int instructionCount() const;
+
+private:
+    void decodeInstructions(const InstructionBuffer& program);
+    void decodeBinary(const std::vector<uint8_t>& bytes);
+    void decodeBinaryV1(const std::vector<uint8_t>& bytes);
+    void finalize(bool fusion);
+    void fuseSuperinstructions();
+    int divisionShift(size_t start, const std::vector<int> &references) const;
+    uint64_t computeHash() const;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "instruction.h"
+#include <sstream>
+#include <stdexcept>
+
+int InstructionBuffer::label(const std::string &name)
+{
+    auto it = labelIds.find(name);
+    if (it != labelIds.end())
+        return it->second;
+    int id = static_cast<int>(labelNames.size());
+    labelNames.push_back(name);
+    labelIds.emplace(name, id);
+    return id;
+}
+
+int InstructionBuffer::string(const std::string &text)
+{
+    auto it = stringIds.find(text);
+    if (it != stringIds.end())
+        return it->second;
+    return defineString("str_" + std::to_string(strings.size()), text);
+}
+
+int InstructionBuffer::defineString(const std::string &name, const std::string &text)
+{
+    int id = static_cast<int>(strings.size());
+    strings.push_back(text);
+    stringNames.push_back(name);
+    stringIds.emplace(text, id);
+    return id;
+}
+
+std::string InstructionBuffer::operandText(const Operand &operand) const
+{
+    switch (operand.kind)
+    {
+    case OperandKind::Register:
+        return "R" + std::to_string(operand.value);
+    case OperandKind::Label:
+        return labelNames[operand.value];
+    case OperandKind::String:
+        return stringNames[operand.value];
+    default:
+        return std::to_string(operand.value);
+    }
+}
+
+std::string InstructionBuffer::format(const Instruction &instr) const
+{
+    std::string text = opcodeName(instr.opcode);
+    if (instr.opcode == Opcode::DATA)
+        return text + " " + stringNames[instr.a.value] + " \"" + strings[instr.a.value] + "\"";
+    if (instr.a.kind != OperandKind::None)
+        text += " " + operandText(instr.a);
+    if (instr.b.kind != OperandKind::None)
+        text += ", " + operandText(instr.b);
+    return text;
+}
+
+std::vector<std::string> InstructionBuffer::toAssembly() const
+{
+    std::vector<std::string> lines;
+    lines.reserve(code.size());
+    for (const Instruction &instr : code)
+        lines.push_back(format(instr));
+    return lines;
+}
+
+static std::string cleanToken(std::string token)
+{
+    if (!token.empty() && token.back() == ',')
+        token.pop_back();
+    return token;
+}
+
+static Operand parseRegister(const std::string &token)
+{
+    if (token.size() == 2 && token[0] == 'R' && token[1] >= '0' && token[1] <= '9')
+        return Operand::reg(token[1] - '0');
+    throw std::runtime_error("Invalid register: " + token);
+}
+
+// Wider literals wrap to 32 bits, as the VM's arithmetic does
+static int32_t parseNumber(const std::string &token)
+{
+    if (token == "true")
+        return 1;
+    if (token == "false")
+        return 0;
+    try
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(std::stoll(token)));
+    }
+    catch (const std::logic_error &)
+    {
+        throw std::runtime_error("Invalid operand: " + token);
+    }
+}
+
+InstructionBuffer InstructionBuffer::parse(const std::vector<std::string> &assembly)
+{
+    // The assembler's opcodes are numbered without gaps from LOAD to ANDI
+    static const std::unordered_map<std::string, Opcode> opcodes = [] {
+        std::unordered_map<std::string, Opcode> byName;
+        for (int op = static_cast<int>(Opcode::LOAD); op <= static_cast<int>(Opcode::ANDI); ++op)
+            byName[opcodeName(static_cast<Opcode>(op))] = static_cast<Opcode>(op);
+        byName["DATA"] = Opcode::DATA;
+        byName["LABEL"] = Opcode::LABEL;
+        return byName;
+    }();
+
+    // DATA lines come last, so string names are collected first
+    InstructionBuffer program;
+    std::unordered_map<std::string, int> stringsByName;
+    for (const std::string &line : assembly)
+    {
+        std::istringstream iss(line);
+        std::string keyword, name;
+        iss >> keyword >> name;
+        if (keyword != "DATA")
+            continue;
+
+        std::string rest;
+        std::getline(iss, rest);
+        size_t firstQuote = rest.find('"');
+        size_t lastQuote = rest.rfind('"');
+        if (firstQuote == std::string::npos || lastQuote <= firstQuote)
+            throw std::runtime_error("Invalid DATA string format: " + line);
+        stringsByName[name] = program.defineString(name, rest.substr(firstQuote + 1, lastQuote - firstQuote - 1));
+    }
+
+    int nextString = 0;
+    for (const std::string &line : assembly)
+    {
+        std::istringstream iss(line);
+        std::string op, arg1, arg2;
+        iss >> op >> arg1 >> arg2;
+        if (op.empty())
+            continue;
+        arg1 = cleanToken(arg1);
+        arg2 = cleanToken(arg2);
+
+        auto it = opcodes.find(op);
+        if (it == opcodes.end())
+            throw std::runtime_error("Unknown instruction: " + op);
+
+        Instruction instr{it->second, {}, {}};
+        switch (instr.opcode)
+        {
+        case Opcode::DATA:
+            instr.a = Operand::string(nextString++);
+            break;
+        case Opcode::LABEL:
+        case Opcode::JMP:
+        case Opcode::JE:
+        case Opcode::JNE:
+        case Opcode::JLT:
+        case Opcode::JGT:
+        case Opcode::JLE:
+        case Opcode::JGE:
+            instr.a = Operand::label(program.label(arg1));
+            break;
+        case Opcode::PRINTS:
+        {
+            auto str = stringsByName.find(arg1);
+            if (str == stringsByName.end())
+                throw std::runtime_error("Unknown string label: " + arg1);
+            instr.a = Operand::string(str->second);
+            break;
+        }
+        case Opcode::PRINT:
+            instr.a = parseRegister(arg1);
+            break;
+        case Opcode::HALT:
+            break;
+        case Opcode::LDM:
+        case Opcode::STM:
+            instr.a = parseRegister(arg1);
+            instr.b = Operand::address(parseNumber(arg2));
+            break;
+        default:
+            instr.a = parseRegister(arg1);
+            instr.b = !arg2.empty() && arg2[0] == 'R' ? parseRegister(arg2) : Operand::imm(parseNumber(arg2));
+            break;
+        }
+        program.code.push_back(instr);
+    }
+    return program;
+}
@@ -0,0 +1,79 @@
+#ifndef INSTRUCTION_H
+#define INSTRUCTION_H
+
+#include "opcodes.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class OperandKind : uint8_t {
+    None,
+    Register,  // R0-R7
+    Immediate,
+    Address,   // VM memory word of LDM / STM
+    Label,     // id in the InstructionBuffer's label table
+    String     // id in the InstructionBuffer's string table
+};
+
+struct Operand {
+    OperandKind kind = OperandKind::None;
+    int32_t value = 0;
+
+    static Operand reg(int number) { return {OperandKind::Register, number}; }
+    static Operand imm(int32_t constant) { return {OperandKind::Immediate, constant}; }
+    static Operand address(int word) { return {OperandKind::Address, word}; }
+    static Operand label(int id) { return {OperandKind::Label, id}; }
+    static Operand string(int id) { return {OperandKind::String, id}; }
+
+    bool isRegister() const { return kind == OperandKind::Register; }
+    bool operator==(const Operand& other) const { return kind == other.kind && value == other.value; }
+    bool operator!=(const Operand& other) const { return !(*this == other); }
+};
+
+// One instruction, or a LABEL / DATA directive naming its label or string
+struct Instruction {
+    Opcode opcode;
+    Operand a;
+    Operand b;
+};
+
+// The program as the code generators emit it, the peephole pass rewrites
+// it, and BinaryGenerator and ProgramImage consume it. Operands refer to
+// labels and strings by id; names only matter when the program is printed
+// as program.asm or read back from it.
+class InstructionBuffer {
+public:
+    std::vector<Instruction> code;
+
+    void emit(Opcode opcode, Operand a = {}, Operand b = {}) { code.push_back({opcode, a, b}); }
+
+    // The id of the label with this name, created on first use
+    int label(const std::string& name);
+    // The id of a string literal; equal texts share one id, named str_<id>
+    int string(const std::string& text);
+
+    size_t labelCount() const { return labelNames.size(); }
+    size_t stringCount() const { return strings.size(); }
+    const std::string& labelName(int id) const { return labelNames[id]; }
+    const std::string& stringName(int id) const { return stringNames[id]; }
+    const std::string& stringText(int id) const { return strings[id]; }
+
+    // program.asm text, one line per instruction
+    std::string format(const Instruction& instr) const;
+    std::vector<std::string> toAssembly() const;
+    // Reads program.asm text back; throws std::runtime_error on a bad line
+    static InstructionBuffer parse(const std::vector<std::string>& assembly);
+
+private:
+    std::vector<std::string> labelNames;
+    std::unordered_map<std::string, int> labelIds;
+    std::vector<std::string> strings;
+    std::vector<std::string> stringNames;
+    std::unordered_map<std::string, int> stringIds; // by text
+
+    int defineString(const std::string& name, const std::string& text);
+    std::string operandText(const Operand& operand) const;
+};
+
+#endif
@@ -0,0 +1,256 @@
+#include "ir.h"
+#include <stdexcept>
+
+bool isCompare(IrOp op)
+{
+    return op == IrOp::Eq || op == IrOp::Ne || op == IrOp::Lt || op == IrOp::Le || op == IrOp::Gt || op == IrOp::Ge;
+}
+
+bool isPure(IrOp op)
+{
+    switch (op)
+    {
+    case IrOp::Const:
+    case IrOp::Copy:
+    case IrOp::Add:
+    case IrOp::Sub:
+    case IrOp::Mul:
+    case IrOp::Shl:
+    case IrOp::Shr:
+    case IrOp::Sar:
+    case IrOp::And:
+    case IrOp::Phi:
+        return true;
+    default:
+        return isCompare(op);
+    }
+}
+
+const char *irOpName(IrOp op)
+{
+    switch (op)
+    {
+    case IrOp::Const: return "const";
+    case IrOp::Copy: return "copy";
+    case IrOp::Add: return "add";
+    case IrOp::Sub: return "sub";
+    case IrOp::Mul: return "mul";
+    case IrOp::Div: return "div";
+    case IrOp::Shl: return "shl";
+    case IrOp::Shr: return "shr";
+    case IrOp::Sar: return "sar";
+    case IrOp::And: return "and";
+    case IrOp::Eq: return "eq";
+    case IrOp::Ne: return "ne";
+    case IrOp::Lt: return "lt";
+    case IrOp::Le: return "le";
+    case IrOp::Gt: return "gt";
+    case IrOp::Ge: return "ge";
+    case IrOp::Phi: return "phi";
+    case IrOp::Print: return "print";
+    case IrOp::PrintString: return "prints";
+    case IrOp::Jump: return "jmp";
+    case IrOp::Branch: return "br";
+    case IrOp::Halt: return "halt";
+    }
+    return "unknown";
+}
+
+int IrFunction::newBlock(const std::string &name)
+{
+    IrBlock block;
+    block.id = static_cast<int>(blocks.size());
+    block.name = name;
+    blocks.push_back(block);
+    return block.id;
+}
+
+int IrFunction::newValue(IrType type)
+{
+    types.push_back(type);
+    return static_cast<int>(types.size()) - 1;
+}
+
+void IrFunction::addEdge(int from, int to)
+{
+    blocks[to].preds.push_back(from);
+}
+
+void IrFunction::replaceUses(int vreg, const IrOperand &with)
+{
+    for (IrBlock &block : blocks)
+    {
+        for (IrInstr &instr : block.instrs)
+        {
+            for (IrOperand &arg : instr.args)
+            {
+                if (arg == IrOperand::reg(vreg))
+                    arg = with;
+            }
+        }
+    }
+}
+
+void IrFunction::verify() const
+{
+    std::vector<int> definitions(types.size(), 0);
+    for (const IrBlock &block : blocks)
+    {
+        std::string where = "bb" + std::to_string(block.id);
+        if (block.instrs.empty() || !block.instrs.back().isTerminator())
+            throw std::runtime_error("IR: " + where + " does not end in a terminator");
+
+        bool pastPhis = false;
+        for (size_t i = 0; i < block.instrs.size(); ++i)
+        {
+            const IrInstr &instr = block.instrs[i];
+            if (instr.isTerminator() && i + 1 != block.instrs.size())
+                throw std::runtime_error("IR: terminator in the middle of " + where);
+            if (instr.op == IrOp::Phi)
+            {
+                if (pastPhis)
+                    throw std::runtime_error("IR: phi after other instructions in " + where);
+                if (instr.args.size() != block.preds.size())
+                    throw std::runtime_error("IR: phi arity does not match the predecessors of " + where);
+            }
+            else
+            {
+                pastPhis = true;
+            }
+
+            if (instr.dst >= static_cast<int>(types.size()))
+                throw std::runtime_error("IR: undeclared register in " + where);
+            if (instr.dst >= 0)
+                ++definitions[instr.dst];
+            for (const IrOperand &arg : instr.args)
+            {
+                if (!arg.immediate && (arg.value < 0 || arg.value >= static_cast<int>(types.size())))
+                    throw std::runtime_error("IR: undeclared register used in " + where);
+            }
+            for (int target : instr.targets)
+            {
+                if (target < 0 || target >= static_cast<int>(blocks.size()))
+                    throw std::runtime_error("IR: branch out of range in " + where);
+                const std::vector<int> &preds = blocks[target].preds;
+                bool listed = false;
+                for (int pred : preds)
+                    listed = listed || pred == block.id;
+                if (!listed)
+                    throw std::runtime_error("IR: edge " + where + " -> bb" + std::to_string(target) + " missing from preds");
+            }
+        }
+    }
+
+    for (const IrBlock &block : blocks)
+    {
+        for (const IrInstr &instr : block.instrs)
+        {
+            if (instr.op == IrOp::Copy)
+                continue; // out of SSA, copies may define a register several times
+            if (instr.dst >= 0 && definitions[instr.dst] > 1)
+                throw std::runtime_error("IR: %" + std::to_string(instr.dst) + " is defined more than once");
+        }
+    }
+}
+
+std::vector<std::vector<bool>> computeLiveIn(const IrFunction &function)
+{
+    size_t valueCount = function.types.size();
+    std::vector<std::vector<bool>> liveIn(function.blocks.size(), std::vector<bool>(valueCount, false));
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t b = function.blocks.size(); b-- > 0;)
+        {
+            const IrBlock &block = function.blocks[b];
+            std::vector<bool> live(valueCount, false);
+            for (int target : block.instrs.back().targets)
+            {
+                const IrBlock &successor = function.blocks[target];
+                size_t from = 0;
+                while (successor.preds[from] != block.id)
+                    ++from;
+                for (size_t v = 0; v < valueCount; ++v)
+                    live[v] = live[v] || liveIn[target][v];
+                for (const IrInstr &phi : successor.instrs)
+                {
+                    if (phi.op != IrOp::Phi)
+                        break;
+                    live[phi.dst] = false;
+                }
+                for (const IrInstr &phi : successor.instrs)
+                {
+                    if (phi.op != IrOp::Phi)
+                        break;
+                    if (!phi.args[from].immediate)
+                        live[phi.args[from].value] = true;
+                }
+            }
+
+            for (size_t i = block.instrs.size(); i-- > 0 && block.instrs[i].op != IrOp::Phi;)
+            {
+                const IrInstr &instr = block.instrs[i];
+                if (instr.dst >= 0)
+                    live[instr.dst] = false;
+                for (const IrOperand &arg : instr.args)
+                {
+                    if (!arg.immediate)
+                        live[arg.value] = true;
+                }
+            }
+            if (live != liveIn[b])
+            {
+                liveIn[b] = std::move(live);
+                changed = true;
+            }
+        }
+    }
+    return liveIn;
+}
+
+static std::string operandText(const IrOperand &operand)
+{
+    return operand.immediate ? std::to_string(operand.value) : "%" + std::to_string(operand.value);
+}
+
+void IrFunction::dump(std::ostream &out) const
+{
+    for (const IrBlock &block : blocks)
+    {
+        out << "bb" << block.id << ":";
+        if (!block.name.empty())
+            out << "  ; " << block.name;
+        if (!block.preds.empty())
+        {
+            out << (block.name.empty() ? "  ; preds" : ", preds");
+            for (int pred : block.preds)
+                out << " bb" << pred;
+        }
+        out << "\n";
+
+        for (const IrInstr &instr : block.instrs)
+        {
+            out << "  ";
+            if (instr.dst >= 0)
+                out << "%" << instr.dst << ":" << (types[instr.dst] == IrType::I1 ? "i1" : "i32") << " = ";
+            out << irOpName(instr.op);
+
+            if (instr.op == IrOp::Phi)
+            {
+                for (size_t i = 0; i < instr.args.size(); ++i)
+                    out << (i ? ", " : " ") << "[bb" << block.preds[i] << ": " << operandText(instr.args[i]) << "]";
+            }
+            else
+            {
+                for (size_t i = 0; i < instr.args.size(); ++i)
+                    out << (i ? ", " : " ") << operandText(instr.args[i]);
+            }
+            if (instr.op == IrOp::PrintString)
+                out << " \"" << instr.text << "\"";
+            for (size_t i = 0; i < instr.targets.size(); ++i)
+                out << (i || !instr.args.empty() ? ", " : " ") << "bb" << instr.targets[i];
+            out << "\n";
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef IR_H
+#define IR_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Mid-level IR: a control-flow graph of basic blocks over virtual
+// registers in SSA form. IrBuilder produces it from the AST and IrLowering
+// turns it into assembly.
+
+enum class IrType {
+    I32,
+    I1 // 0 or 1 in a full register, so it may feed i32 arithmetic directly
+};
+
+enum class IrOp {
+    Const,  // dst = immediate
+    Copy,   // dst = a; only introduced when leaving SSA, where a run of
+            // copies ending a block executes as one parallel copy
+    Add,    // dst = a op b
+    Sub,
+    Mul,
+    Div,
+    Shl,    // shift counts are taken modulo 32
+    Shr,    // logical
+    Sar,    // arithmetic
+    And,
+    Eq,     // dst:i1 = a cmp b
+    Ne,
+    Lt,
+    Le,
+    Gt,
+    Ge,
+    Phi,    // dst = the argument for the predecessor control came from
+    Print,
+    PrintString,
+    Jump,   // terminators
+    Branch, // to targets[0] when a is non-zero, else targets[1]
+    Halt
+};
+
+struct IrOperand {
+    bool immediate = false;
+    int value = 0; // virtual register number, or the immediate itself
+
+    static IrOperand reg(int vreg) { return {false, vreg}; }
+    static IrOperand imm(int constant) { return {true, constant}; }
+
+    bool operator==(const IrOperand& other) const { return immediate == other.immediate && value == other.value; }
+    bool operator!=(const IrOperand& other) const { return !(*this == other); }
+};
+
+struct IrInstr {
+    IrOp op;
+    int dst = -1;                // defined register, -1 when none
+    std::vector<IrOperand> args; // a phi has one per predecessor, in IrBlock::preds order
+    std::vector<int> targets;    // successor blocks of Jump / Branch
+    std::string text;            // PrintString
+
+    bool isTerminator() const { return op == IrOp::Jump || op == IrOp::Branch || op == IrOp::Halt; }
+};
+
+struct IrBlock {
+    int id = 0;
+    std::string name;            // label stem, e.g. "while"
+    std::vector<int> preds;
+    std::vector<IrInstr> instrs; // phis first, exactly one terminator last
+};
+
+class IrFunction {
+public:
+    std::vector<IrBlock> blocks; // blocks[0] is the entry; order is the code layout
+    std::vector<IrType> types;   // per virtual register
+
+    int newBlock(const std::string& name);
+    int newValue(IrType type);
+    void addEdge(int from, int to);
+
+    void replaceUses(int vreg, const IrOperand& with);
+
+    // Throws std::runtime_error describing the first malformed construct
+    void verify() const;
+    void dump(std::ostream& out) const;
+};
+
+// For each block, the registers live just after its phis (so including
+// those phis that are read). A phi argument is read at the end of its
+// predecessor.
+std::vector<std::vector<bool>> computeLiveIn(const IrFunction& function);
+
+bool isCompare(IrOp op);
+bool isPure(IrOp op); // no effect besides defining dst, and cannot fault
+const char* irOpName(IrOp op);
+
+#endif
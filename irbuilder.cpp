@@ -0,0 +1,440 @@
+#include "irbuilder.h"
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <stdexcept>
+
+static void collectAssigned(const std::vector<std::unique_ptr<Stmt>> &block, std::set<std::string> &names)
+{
+    for (const auto &stmt : block)
+    {
+        if (stmt->type == StmtType::VAR_DECL)
+            names.insert(static_cast<VarDeclStmt *>(stmt.get())->varName);
+        else if (stmt->type == StmtType::ASSIGN)
+            names.insert(static_cast<AssignStmt *>(stmt.get())->varName);
+        else if (stmt->type == StmtType::WHILE)
+            collectAssigned(static_cast<WhileStmt *>(stmt.get())->body, names);
+        else if (stmt->type == StmtType::IF)
+        {
+            // An else-if is an IfStmt of its own; walk the chain iteratively
+            for (auto *ifStmt = static_cast<IfStmt *>(stmt.get()); ifStmt; ifStmt = ifStmt->elseIfStmt.get())
+            {
+                collectAssigned(ifStmt->thenBranch, names);
+                collectAssigned(ifStmt->elseBranch, names);
+            }
+        }
+    }
+}
+
+static IrOp binaryOp(const std::string &op)
+{
+    if (op == "+")
+        return IrOp::Add;
+    if (op == "-")
+        return IrOp::Sub;
+    if (op == "*")
+        return IrOp::Mul;
+    if (op == "/")
+        return IrOp::Div;
+    if (op == "==")
+        return IrOp::Eq;
+    if (op == "!=")
+        return IrOp::Ne;
+    if (op == "<")
+        return IrOp::Lt;
+    if (op == "<=")
+        return IrOp::Le;
+    if (op == ">")
+        return IrOp::Gt;
+    if (op == ">=")
+        return IrOp::Ge;
+    throw std::runtime_error("Unknown operator: " + op);
+}
+
+// The comparison that holds with its operands swapped
+static IrOp mirror(IrOp op)
+{
+    switch (op)
+    {
+    case IrOp::Lt: return IrOp::Gt;
+    case IrOp::Gt: return IrOp::Lt;
+    case IrOp::Le: return IrOp::Ge;
+    case IrOp::Ge: return IrOp::Le;
+    default: return op;
+    }
+}
+
+IrFunction IrBuilder::build(const std::vector<std::unique_ptr<Stmt>> &program)
+{
+    function = IrFunction();
+    definitions.clear();
+    layout.clear();
+
+    startBlock(function.newBlock("entry"));
+    buildBlock(program);
+    IrInstr halt;
+    halt.op = IrOp::Halt;
+    emit(halt);
+
+    removeUnreachable();
+    removeTrivialPhis();
+    removeDeadValues();
+    function.verify();
+    return std::move(function);
+}
+
+void IrBuilder::startBlock(int block)
+{
+    current = block;
+    layout.push_back(block);
+}
+
+void IrBuilder::emit(const IrInstr &instr)
+{
+    function.blocks[current].instrs.push_back(instr);
+}
+
+int IrBuilder::emitValue(IrOp op, IrType type, std::vector<IrOperand> args)
+{
+    IrInstr instr;
+    instr.op = op;
+    instr.dst = function.newValue(type);
+    instr.args = std::move(args);
+    emit(instr);
+    return instr.dst;
+}
+
+void IrBuilder::jump(int target)
+{
+    IrInstr instr;
+    instr.op = IrOp::Jump;
+    instr.targets = {target};
+    emit(instr);
+    function.addEdge(current, target);
+}
+
+void IrBuilder::branch(const IrOperand &condition, int ifTrue, int ifFalse)
+{
+    IrInstr instr;
+    instr.op = IrOp::Branch;
+    instr.args = {condition};
+    instr.targets = {ifTrue, ifFalse};
+    emit(instr);
+    function.addEdge(current, ifTrue);
+    function.addEdge(current, ifFalse);
+}
+
+IrOperand IrBuilder::lookup(const Definitions &defs, const std::string &name) const
+{
+    auto it = defs.find(name);
+    return it == defs.end() ? IrOperand::imm(0) : it->second;
+}
+
+void IrBuilder::buildBlock(const std::vector<std::unique_ptr<Stmt>> &block)
+{
+    for (const auto &stmt : block)
+        buildStmt(stmt.get());
+}
+
+void IrBuilder::buildStmt(Stmt *stmt)
+{
+    if (stmt->type == StmtType::VAR_DECL)
+    {
+        auto *decl = static_cast<VarDeclStmt *>(stmt);
+        definitions[decl->varName] = buildExpr(decl->initializer.get());
+    }
+    else if (stmt->type == StmtType::ASSIGN)
+    {
+        auto *assign = static_cast<AssignStmt *>(stmt);
+        definitions[assign->varName] = buildExpr(assign->value.get());
+    }
+    else if (stmt->type == StmtType::PRINT)
+    {
+        Expr *expr = static_cast<PrintStmt *>(stmt)->expression.get();
+        IrInstr print;
+        if (expr->type == ExprType::STRING_LITERAL)
+        {
+            print.op = IrOp::PrintString;
+            print.text = static_cast<StringLiteralExpr *>(expr)->value;
+        }
+        else
+        {
+            print.op = IrOp::Print;
+            print.args = {buildExpr(expr)};
+        }
+        emit(print);
+    }
+    else if (stmt->type == StmtType::IF)
+    {
+        buildIf(static_cast<IfStmt *>(stmt));
+    }
+    else if (stmt->type == StmtType::WHILE)
+    {
+        buildWhile(static_cast<WhileStmt *>(stmt));
+    }
+}
+
+void IrBuilder::buildIf(IfStmt *ifStmt)
+{
+    IrOperand condition = buildExpr(ifStmt->condition.get());
+    if (condition.immediate)
+    {
+        if (condition.value)
+            buildBlock(ifStmt->thenBranch);
+        else if (ifStmt->elseIfStmt)
+            buildIf(ifStmt->elseIfStmt.get());
+        else
+            buildBlock(ifStmt->elseBranch);
+        return;
+    }
+
+    int thenBlock = function.newBlock("then");
+    int elseBlock = function.newBlock("else");
+    int endBlock = function.newBlock("endif");
+    branch(condition, thenBlock, elseBlock);
+    Definitions before = definitions;
+
+    startBlock(thenBlock);
+    buildBlock(ifStmt->thenBranch);
+    Definitions thenDefinitions = std::move(definitions);
+    jump(endBlock);
+
+    definitions = std::move(before);
+    startBlock(elseBlock);
+    if (ifStmt->elseIfStmt)
+        buildIf(ifStmt->elseIfStmt.get());
+    else
+        buildBlock(ifStmt->elseBranch);
+    Definitions elseDefinitions = std::move(definitions);
+    jump(endBlock);
+
+    // endif's predecessors are the then arm and the else arm, in that order
+    startBlock(endBlock);
+    definitions.clear();
+    std::set<std::string> names;
+    for (const auto &entry : thenDefinitions)
+        names.insert(entry.first);
+    for (const auto &entry : elseDefinitions)
+        names.insert(entry.first);
+    for (const std::string &name : names)
+    {
+        IrOperand fromThen = lookup(thenDefinitions, name);
+        IrOperand fromElse = lookup(elseDefinitions, name);
+        if (fromThen == fromElse)
+            definitions[name] = fromThen;
+        else
+            definitions[name] = IrOperand::reg(emitValue(IrOp::Phi, IrType::I32, {fromThen, fromElse}));
+    }
+}
+
+// The header gets a phi for everything the body assigns; the back-edge
+// arguments are filled in once the body has been built.
+void IrBuilder::buildWhile(WhileStmt *loop)
+{
+    int header = function.newBlock("while");
+    int body = function.newBlock("whilebody");
+    int exit = function.newBlock("endwhile");
+
+    std::set<std::string> assigned;
+    collectAssigned(loop->body, assigned);
+
+    jump(header);
+    startBlock(header);
+    std::vector<std::string> phiNames(assigned.begin(), assigned.end());
+    for (const std::string &name : phiNames)
+        definitions[name] = IrOperand::reg(emitValue(IrOp::Phi, IrType::I32, {lookup(definitions, name)}));
+
+    IrOperand condition = buildExpr(loop->condition.get());
+    if (condition.immediate)
+        jump(condition.value ? body : exit);
+    else
+        branch(condition, body, exit);
+    Definitions atHeader = definitions;
+
+    startBlock(body);
+    buildBlock(loop->body);
+    for (size_t i = 0; i < phiNames.size(); ++i)
+        function.blocks[header].instrs[i].args.push_back(lookup(definitions, phiNames[i]));
+    jump(header);
+
+    definitions = std::move(atHeader);
+    startBlock(exit);
+}
+
+IrOperand IrBuilder::buildExpr(Expr *expr)
+{
+    if (expr->type == ExprType::LITERAL)
+    {
+        const std::string &text = static_cast<LiteralExpr *>(expr)->value;
+        if (text == "true" || text == "false")
+            return IrOperand::imm(text == "true" ? 1 : 0);
+        return IrOperand::imm(static_cast<int>(static_cast<uint32_t>(std::stoll(text))));
+    }
+    if (expr->type == ExprType::VARIABLE)
+        return lookup(definitions, static_cast<VariableExpr *>(expr)->name);
+    if (expr->type == ExprType::STRING_LITERAL)
+        throw std::runtime_error("String literal used as a number: \"" + static_cast<StringLiteralExpr *>(expr)->value + "\"");
+
+    auto *bin = static_cast<BinaryExpr *>(expr);
+    IrOp op = binaryOp(bin->op);
+    IrOperand left = buildExpr(bin->left.get());
+    IrOperand right = buildExpr(bin->right.get());
+
+    // Keep immediates on the right, where the ISA's immediate forms take them
+    if (left.immediate && !right.immediate && (op == IrOp::Add || op == IrOp::Mul || isCompare(op)))
+    {
+        std::swap(left, right);
+        op = mirror(op);
+    }
+    else if (left.immediate)
+    {
+        left = IrOperand::reg(emitValue(IrOp::Const, IrType::I32, {left}));
+    }
+    return IrOperand::reg(emitValue(op, isCompare(op) ? IrType::I1 : IrType::I32, {left, right}));
+}
+
+// Drops blocks control never reaches, together with their phi arguments,
+// and renumbers the rest in the order their code was built
+void IrBuilder::removeUnreachable()
+{
+    std::vector<bool> reachable(function.blocks.size(), false);
+    std::vector<int> worklist = {0};
+    reachable[0] = true;
+    while (!worklist.empty())
+    {
+        int block = worklist.back();
+        worklist.pop_back();
+        for (int target : function.blocks[block].instrs.back().targets)
+        {
+            if (!reachable[target])
+            {
+                reachable[target] = true;
+                worklist.push_back(target);
+            }
+        }
+    }
+
+    std::vector<int> renumbered(function.blocks.size(), -1);
+    std::vector<IrBlock> blocks;
+    for (int block : layout)
+    {
+        if (!reachable[block])
+            continue;
+        renumbered[block] = static_cast<int>(blocks.size());
+        blocks.push_back(std::move(function.blocks[block]));
+    }
+
+    for (IrBlock &block : blocks)
+    {
+        block.id = renumbered[block.id];
+        std::vector<bool> keep;
+        std::vector<int> preds;
+        for (int pred : block.preds)
+        {
+            keep.push_back(renumbered[pred] >= 0);
+            if (keep.back())
+                preds.push_back(renumbered[pred]);
+        }
+        block.preds = std::move(preds);
+
+        for (IrInstr &instr : block.instrs)
+        {
+            for (int &target : instr.targets)
+                target = renumbered[target];
+            if (instr.op != IrOp::Phi)
+                continue;
+            std::vector<IrOperand> args;
+            for (size_t i = 0; i < instr.args.size(); ++i)
+            {
+                if (keep[i])
+                    args.push_back(instr.args[i]);
+            }
+            instr.args = std::move(args);
+        }
+    }
+    function.blocks = std::move(blocks);
+}
+
+// A phi whose arguments are all one operand, or itself, is that operand
+void IrBuilder::removeTrivialPhis()
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (IrBlock &block : function.blocks)
+        {
+            for (size_t i = 0; i < block.instrs.size() && block.instrs[i].op == IrOp::Phi;)
+            {
+                const IrInstr &phi = block.instrs[i];
+                IrOperand self = IrOperand::reg(phi.dst);
+                IrOperand value = IrOperand::imm(0);
+                bool found = false;
+                bool trivial = true;
+                for (const IrOperand &arg : phi.args)
+                {
+                    if (arg == self || (found && arg == value))
+                        continue;
+                    trivial = trivial && !found;
+                    value = arg;
+                    found = true;
+                }
+                if (!trivial)
+                {
+                    ++i;
+                    continue;
+                }
+                int dst = phi.dst;
+                block.instrs.erase(block.instrs.begin() + i);
+                function.replaceUses(dst, value);
+                changed = true;
+            }
+        }
+    }
+}
+
+// Keeps what printing, branching or a possible fault depends on. Marking
+// from those roots also drops phi cycles that only feed each other, as a
+// variable assigned in a loop but never read afterwards leaves behind.
+void IrBuilder::removeDeadValues()
+{
+    std::vector<const IrInstr *> definition(function.types.size(), nullptr);
+    std::vector<int> worklist;
+    for (const IrBlock &block : function.blocks)
+    {
+        for (const IrInstr &instr : block.instrs)
+        {
+            if (instr.dst >= 0)
+                definition[instr.dst] = &instr;
+            if (isPure(instr.op))
+                continue;
+            for (const IrOperand &arg : instr.args)
+            {
+                if (!arg.immediate)
+                    worklist.push_back(arg.value);
+            }
+        }
+    }
+
+    std::vector<bool> live(function.types.size(), false);
+    while (!worklist.empty())
+    {
+        int value = worklist.back();
+        worklist.pop_back();
+        if (live[value])
+            continue;
+        live[value] = true;
+        for (const IrOperand &arg : definition[value]->args)
+        {
+            if (!arg.immediate)
+                worklist.push_back(arg.value);
+        }
+    }
+
+    for (IrBlock &block : function.blocks)
+    {
+        block.instrs.erase(std::remove_if(block.instrs.begin(), block.instrs.end(), [&](const IrInstr &instr)
+                                          { return instr.dst >= 0 && isPure(instr.op) && !live[instr.dst]; }),
+                           block.instrs.end());
+    }
+}
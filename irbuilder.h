@@ -0,0 +1,47 @@
+#ifndef IRBUILDER_H
+#define IRBUILDER_H
+
+#include "ast.h"
+#include "ir.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// Lowers the AST to SSA form. Variables never become storage: each name
+// maps to the operand that last defined it, and control-flow joins get a
+// phi for every name whose definitions differ. Each if has an else block
+// and each loop a separate exit, so no edge runs from a block with several
+// successors into one with several predecessors. A variable read before
+// any assignment is 0, as the VM's registers and memory start out.
+class IrBuilder
+{
+public:
+    IrFunction build(const std::vector<std::unique_ptr<Stmt>> &program);
+
+private:
+    using Definitions = std::map<std::string, IrOperand>;
+
+    IrFunction function;
+    Definitions definitions;
+    int current = 0;
+    std::vector<int> layout; // blocks in the order code was placed in them
+
+    void startBlock(int block);
+    void emit(const IrInstr &instr);
+    int emitValue(IrOp op, IrType type, std::vector<IrOperand> args);
+    void jump(int target);
+    void branch(const IrOperand &condition, int ifTrue, int ifFalse);
+
+    void buildBlock(const std::vector<std::unique_ptr<Stmt>> &block);
+    void buildStmt(Stmt *stmt);
+    void buildIf(IfStmt *ifStmt);
+    void buildWhile(WhileStmt *loop);
+    IrOperand buildExpr(Expr *expr);
+    IrOperand lookup(const Definitions &defs, const std::string &name) const;
+
+    void removeUnreachable();
+    void removeTrivialPhis();
+    void removeDeadValues();
+};
+
+#endif
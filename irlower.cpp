@@ -0,0 +1,735 @@
+#include "irlower.h"
+#include "opcodes.h"
+#include <algorithm>
+#include <stdexcept>
+
+static const int FIRST_REGISTER = 1;
+static const int LAST_REGISTER = FIRST_REGISTER + IR_ALLOCATABLE_REGISTERS - 1;
+static const int LAST_REGISTER_WHEN_SPILLING = 5; // R6/R7 load spilled values
+
+static bool fitsImmediate(const IrOperand &operand)
+{
+    return operand.immediate && operand.value >= IMMEDIATE_MIN && operand.value <= IMMEDIATE_MAX;
+}
+
+static IrOp mirror(IrOp op)
+{
+    switch (op)
+    {
+    case IrOp::Lt: return IrOp::Gt;
+    case IrOp::Gt: return IrOp::Lt;
+    case IrOp::Le: return IrOp::Ge;
+    case IrOp::Ge: return IrOp::Le;
+    default: return op;
+    }
+}
+
+static bool evaluateCompare(IrOp op, int left, int right)
+{
+    switch (op)
+    {
+    case IrOp::Eq: return left == right;
+    case IrOp::Ne: return left != right;
+    case IrOp::Lt: return left < right;
+    case IrOp::Le: return left <= right;
+    case IrOp::Gt: return left > right;
+    default: return left >= right;
+    }
+}
+
+static Opcode jumpFor(IrOp op, bool inverted)
+{
+    switch (op)
+    {
+    case IrOp::Eq: return inverted ? Opcode::JNE : Opcode::JE;
+    case IrOp::Ne: return inverted ? Opcode::JE : Opcode::JNE;
+    case IrOp::Lt: return inverted ? Opcode::JGE : Opcode::JLT;
+    case IrOp::Le: return inverted ? Opcode::JGT : Opcode::JLE;
+    case IrOp::Gt: return inverted ? Opcode::JLE : Opcode::JGT;
+    default: return inverted ? Opcode::JLT : Opcode::JGE;
+    }
+}
+
+static bool overlaps(const std::vector<std::pair<int, int>> &a, const std::vector<std::pair<int, int>> &b)
+{
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a.size() && j < b.size())
+    {
+        if (a[i].second <= b[j].first)
+            ++i;
+        else if (b[j].second <= a[i].first)
+            ++j;
+        else
+            return true;
+    }
+    return false;
+}
+
+InstructionBuffer IrLowering::lower(IrFunction ir)
+{
+    function = std::move(ir);
+    program = InstructionBuffer();
+    eliminatePhis();
+    markFusedCompares();
+    buildSteps();
+
+    std::vector<Ranges> ranges = computeLiveRanges();
+    if (!assignLocations(ranges, false))
+        assignLocations(ranges, true);
+
+    std::vector<std::vector<Instruction>> code(function.blocks.size());
+    referenced.assign(function.blocks.size(), false);
+    for (size_t block = 0; block < function.blocks.size(); ++block)
+        emitBlock(static_cast<int>(block), code[block]);
+
+    for (size_t block = 0; block < function.blocks.size(); ++block)
+    {
+        if (referenced[block])
+            program.emit(Opcode::LABEL, Operand::label(label(static_cast<int>(block))));
+        program.code.insert(program.code.end(), code[block].begin(), code[block].end());
+    }
+    for (size_t id = 0; id < program.stringCount(); ++id)
+        program.emit(Opcode::DATA, Operand::string(static_cast<int>(id)));
+    return std::move(program);
+}
+
+void IrLowering::eliminatePhis()
+{
+    for (IrBlock &block : function.blocks)
+    {
+        size_t phis = 0;
+        for (; phis < block.instrs.size() && block.instrs[phis].op == IrOp::Phi; ++phis)
+        {
+            const IrInstr &phi = block.instrs[phis];
+            for (size_t i = 0; i < block.preds.size(); ++i)
+            {
+                std::vector<IrInstr> &pred = function.blocks[block.preds[i]].instrs;
+                if (pred.back().op != IrOp::Jump)
+                    throw std::runtime_error("IR: critical edge into bb" + std::to_string(block.id));
+                IrInstr copy;
+                copy.op = IrOp::Copy;
+                copy.dst = phi.dst;
+                copy.args = {phi.args[i]};
+                pred.insert(pred.end() - 1, copy);
+            }
+        }
+        block.instrs.erase(block.instrs.begin(), block.instrs.begin() + phis);
+    }
+}
+
+void IrLowering::markFusedCompares()
+{
+    std::vector<int> uses(function.types.size(), 0);
+    for (const IrBlock &block : function.blocks)
+    {
+        for (const IrInstr &instr : block.instrs)
+        {
+            for (const IrOperand &arg : instr.args)
+            {
+                if (!arg.immediate)
+                    ++uses[arg.value];
+            }
+        }
+    }
+
+    fused.assign(function.types.size(), false);
+    for (const IrBlock &block : function.blocks)
+    {
+        size_t count = block.instrs.size();
+        if (count < 2 || block.instrs.back().op != IrOp::Branch)
+            continue;
+        const IrInstr &compare = block.instrs[count - 2];
+        if (isCompare(compare.op) && block.instrs.back().args[0] == IrOperand::reg(compare.dst) && uses[compare.dst] == 1)
+            fused[compare.dst] = true;
+    }
+}
+
+// Numbers the instructions in layout order. A run of copies is one
+// parallel copy, so all of its reads happen before any of its writes.
+void IrLowering::buildSteps()
+{
+    size_t count = function.blocks.size();
+    steps.assign(count, {});
+    blockStart.assign(count, 0);
+    blockEnd.assign(count, 0);
+    loopDepth.assign(count, 0);
+
+    int index = 0;
+    for (size_t b = 0; b < count; ++b)
+    {
+        blockStart[b] = 2 * index;
+        const std::vector<IrInstr> &instrs = function.blocks[b].instrs;
+        for (size_t i = 0; i < instrs.size(); ++i)
+        {
+            const IrInstr &instr = instrs[i];
+            if (instr.op != IrOp::Copy || i == 0 || instrs[i - 1].op != IrOp::Copy)
+                steps[b].push_back({index++, {}, {}});
+            Step &step = steps[b].back();
+
+            bool fusedBranch = instr.op == IrOp::Branch && !instr.args[0].immediate && fused[instr.args[0].value];
+            for (const IrOperand &arg : instr.args)
+            {
+                if (!arg.immediate && !fusedBranch)
+                    step.uses.push_back(arg.value);
+            }
+            if (instr.dst >= 0 && !fused[instr.dst])
+                step.defs.push_back(instr.dst);
+        }
+        blockEnd[b] = 2 * index;
+
+        // Loops are laid out contiguously from header to back edge
+        for (int target : instrs.back().targets)
+        {
+            if (target <= static_cast<int>(b))
+            {
+                for (size_t inside = target; inside <= b; ++inside)
+                    ++loopDepth[inside];
+            }
+        }
+    }
+}
+
+std::vector<IrLowering::Ranges> IrLowering::computeLiveRanges() const
+{
+    size_t blockCount = function.blocks.size();
+    size_t valueCount = function.types.size();
+
+    std::vector<std::vector<bool>> liveIn(blockCount, std::vector<bool>(valueCount, false));
+    std::vector<std::vector<bool>> liveOut(blockCount, std::vector<bool>(valueCount, false));
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t b = blockCount; b-- > 0;)
+        {
+            std::vector<bool> live(valueCount, false);
+            for (int target : function.blocks[b].instrs.back().targets)
+            {
+                for (size_t v = 0; v < valueCount; ++v)
+                    live[v] = live[v] || liveIn[target][v];
+            }
+            liveOut[b] = live;
+            for (size_t s = steps[b].size(); s-- > 0;)
+            {
+                for (int def : steps[b][s].defs)
+                    live[def] = false;
+                for (int use : steps[b][s].uses)
+                    live[use] = true;
+            }
+            if (live != liveIn[b])
+            {
+                liveIn[b] = std::move(live);
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<Ranges> ranges(valueCount);
+    std::vector<int> openEnd(valueCount, 0);
+    for (size_t b = blockCount; b-- > 0;)
+    {
+        std::vector<bool> live = liveOut[b];
+        for (size_t v = 0; v < valueCount; ++v)
+        {
+            if (live[v])
+                openEnd[v] = blockEnd[b];
+        }
+        for (size_t s = steps[b].size(); s-- > 0;)
+        {
+            const Step &step = steps[b][s];
+            int usePosition = 2 * step.index;
+            for (int def : step.defs)
+            {
+                if (live[def])
+                    ranges[def].push_back({usePosition + 1, openEnd[def]});
+                else
+                    ranges[def].push_back({usePosition + 1, usePosition + 2});
+                live[def] = false;
+            }
+            for (int use : step.uses)
+            {
+                if (!live[use])
+                {
+                    live[use] = true;
+                    openEnd[use] = usePosition + 1;
+                }
+            }
+        }
+        for (size_t v = 0; v < valueCount; ++v)
+        {
+            if (live[v])
+                ranges[v].push_back({blockStart[b], openEnd[v]});
+        }
+    }
+
+    for (Ranges &range : ranges)
+    {
+        std::sort(range.begin(), range.end());
+        Ranges merged;
+        for (const auto &segment : range)
+        {
+            if (!merged.empty() && segment.first <= merged.back().second)
+                merged.back().second = std::max(merged.back().second, segment.second);
+            else
+                merged.push_back(segment);
+        }
+        range = std::move(merged);
+    }
+    return ranges;
+}
+
+// First fit in order of range start. Returns false when a value did not
+// fit in a register and spills were not allowed.
+bool IrLowering::assignLocations(const std::vector<Ranges> &ranges, bool allowSpills)
+{
+    size_t valueCount = function.types.size();
+    std::vector<int> order;
+    for (size_t v = 0; v < valueCount; ++v)
+    {
+        if (!ranges[v].empty())
+            order.push_back(static_cast<int>(v));
+    }
+    // Copy partners and left operands, to share a register with, and the
+    // right operand of a non-commutative operation, which the result
+    // should not share
+    std::vector<std::vector<int>> related(valueCount);
+    std::vector<int> avoid(valueCount, -1);
+    std::vector<long long> weight(valueCount, 0);
+    for (size_t b = 0; b < function.blocks.size(); ++b)
+    {
+        long long frequency = 1LL << (3 * std::min(loopDepth[b], 6));
+        for (const IrInstr &instr : function.blocks[b].instrs)
+        {
+            if (instr.dst >= 0)
+                weight[instr.dst] += frequency;
+            for (const IrOperand &arg : instr.args)
+            {
+                if (!arg.immediate)
+                    weight[arg.value] += frequency;
+            }
+            if (instr.dst >= 0 && !instr.args.empty() && !instr.args[0].immediate &&
+                (instr.op == IrOp::Copy || !isCompare(instr.op)))
+            {
+                related[instr.dst].push_back(instr.args[0].value);
+                related[instr.args[0].value].push_back(instr.dst);
+            }
+            bool nonCommutative = instr.op == IrOp::Sub || instr.op == IrOp::Div || instr.op == IrOp::Shl ||
+                                  instr.op == IrOp::Shr || instr.op == IrOp::Sar;
+            if (nonCommutative && !instr.args[1].immediate)
+                avoid[instr.dst] = instr.args[1].value;
+        }
+    }
+
+    // Values defined together, as by one parallel copy, go most related first
+    std::sort(order.begin(), order.end(), [&](int a, int b)
+              {
+        if (ranges[a].front().first != ranges[b].front().first)
+            return ranges[a].front().first < ranges[b].front().first;
+        return related[a].size() > related[b].size(); });
+
+    int lastRegister = allowSpills ? LAST_REGISTER_WHEN_SPILLING : LAST_REGISTER;
+    std::vector<std::vector<int>> holders(lastRegister + 1); // values in each register
+    std::vector<std::vector<int>> slotHolders;
+    locations.assign(valueCount, VariableLocation());
+
+    auto conflicts = [&](int value, const std::vector<int> &holding)
+    {
+        std::vector<int> found;
+        for (int other : holding)
+        {
+            if (overlaps(ranges[value], ranges[other]))
+                found.push_back(other);
+        }
+        return found;
+    };
+    auto spill = [&](int value)
+    {
+        size_t slot = 0;
+        while (slot < slotHolders.size() && !conflicts(value, slotHolders[slot]).empty())
+            ++slot;
+        if (slot == static_cast<size_t>(VM_MEMORY_SIZE))
+            throw std::runtime_error("Too many live values to spill");
+        if (slot == slotHolders.size())
+            slotHolders.emplace_back();
+        slotHolders[slot].push_back(value);
+        locations[value].reg = -1;
+        locations[value].slot = static_cast<int>(slot);
+    };
+
+    for (int value : order)
+    {
+        std::vector<int> candidates;
+        for (int partner : related[value])
+        {
+            if (locations[partner].reg >= 0)
+                candidates.push_back(locations[partner].reg);
+        }
+        for (int reg = FIRST_REGISTER; reg <= lastRegister; ++reg)
+            candidates.push_back(reg);
+        if (avoid[value] >= 0 && locations[avoid[value]].reg >= 0)
+        {
+            int avoided = locations[avoid[value]].reg;
+            std::stable_partition(candidates.begin(), candidates.end(), [&](int reg)
+                                  { return reg != avoided; });
+        }
+
+        int chosen = -1;
+        for (int reg : candidates)
+        {
+            if (conflicts(value, holders[reg]).empty())
+            {
+                chosen = reg;
+                break;
+            }
+        }
+
+        if (chosen < 0 && !allowSpills)
+            return false;
+        if (chosen < 0)
+        {
+            // Evict from the register whose occupants here are used least
+            long long cheapest = weight[value];
+            std::vector<int> evicted;
+            for (int reg = FIRST_REGISTER; reg <= lastRegister; ++reg)
+            {
+                std::vector<int> occupants = conflicts(value, holders[reg]);
+                long long cost = 0;
+                for (int other : occupants)
+                    cost += weight[other];
+                if (cost < cheapest)
+                {
+                    cheapest = cost;
+                    chosen = reg;
+                    evicted = std::move(occupants);
+                }
+            }
+            if (chosen < 0)
+            {
+                spill(value);
+                continue;
+            }
+            for (int other : evicted)
+            {
+                std::vector<int> &holding = holders[chosen];
+                holding.erase(std::find(holding.begin(), holding.end(), other));
+                spill(other);
+            }
+        }
+        holders[chosen].push_back(value);
+        locations[value].reg = chosen;
+    }
+    return true;
+}
+
+// A register, a memory address for spilled values, or an immediate
+Operand IrLowering::place(const IrOperand &operand) const
+{
+    if (operand.immediate)
+        return Operand::imm(operand.value);
+    const VariableLocation &location = locations[operand.value];
+    if (location.spilled())
+        return Operand::address(location.slot);
+    return Operand::reg(location.reg);
+}
+
+void IrLowering::emitMove(const Operand &dst, const Operand &src, std::vector<Instruction> &out)
+{
+    if (dst == src)
+        return;
+    if (dst.kind == OperandKind::Address)
+    {
+        Operand reg = src;
+        if (!src.isRegister())
+        {
+            reg = Operand::reg(6);
+            emitMove(reg, src, out);
+        }
+        out.push_back({Opcode::STM, reg, dst});
+    }
+    else if (src.kind == OperandKind::Immediate)
+        out.push_back({Opcode::LOAD, dst, src});
+    else if (src.kind == OperandKind::Address)
+        out.push_back({Opcode::LDM, dst, src});
+    else
+        out.push_back({Opcode::MOV, dst, src});
+}
+
+// The register holding operand, loading it into scratch when it has none
+int IrLowering::operandRegister(const IrOperand &operand, int scratch, std::vector<Instruction> &out)
+{
+    Operand where = place(operand);
+    if (where.isRegister())
+        return where.value;
+    emitMove(Operand::reg(scratch), where, out);
+    return scratch;
+}
+
+// The register an instruction computes vreg into
+int IrLowering::target(int vreg) const
+{
+    return locations[vreg].spilled() ? 6 : locations[vreg].reg;
+}
+
+void IrLowering::finish(int vreg, int reg, std::vector<Instruction> &out)
+{
+    if (locations[vreg].spilled())
+        emitMove(place(IrOperand::reg(vreg)), Operand::reg(reg), out);
+}
+
+// Skips over blocks that hold nothing but a jump
+int IrLowering::resolve(int block) const
+{
+    for (size_t hops = 0; hops < function.blocks.size(); ++hops)
+    {
+        const std::vector<IrInstr> &instrs = function.blocks[block].instrs;
+        if (instrs.size() != 1 || instrs[0].op != IrOp::Jump)
+            break;
+        block = instrs[0].targets[0];
+    }
+    return block;
+}
+
+int IrLowering::fallthrough(int block) const
+{
+    return block + 1 < static_cast<int>(function.blocks.size()) ? resolve(block + 1) : -1;
+}
+
+int IrLowering::label(int block)
+{
+    return program.label(function.blocks[block].name + "_" + std::to_string(block));
+}
+
+void IrLowering::emitJump(int block, int to, std::vector<Instruction> &out)
+{
+    to = resolve(to);
+    if (to == fallthrough(block))
+        return;
+    referenced[to] = true;
+    out.push_back({Opcode::JMP, Operand::label(label(to)), {}});
+}
+
+// Jumps to ifTrue when the flags satisfy compare, else to ifFalse, falling
+// through to whichever comes next
+void IrLowering::emitBranch(int block, IrOp compare, int ifTrue, int ifFalse, std::vector<Instruction> &out)
+{
+    ifTrue = resolve(ifTrue);
+    ifFalse = resolve(ifFalse);
+    int next = fallthrough(block);
+    if (ifTrue == ifFalse)
+    {
+        emitJump(block, ifTrue, out);
+        return;
+    }
+    if (ifTrue == next)
+    {
+        referenced[ifFalse] = true;
+        out.push_back({jumpFor(compare, true), Operand::label(label(ifFalse)), {}});
+        return;
+    }
+    referenced[ifTrue] = true;
+    out.push_back({jumpFor(compare, false), Operand::label(label(ifTrue)), {}});
+    emitJump(block, ifFalse, out);
+}
+
+// Sequentializes moves that all read before any writes. A cycle is broken
+// by saving one destination in R0.
+void IrLowering::emitParallelCopy(std::vector<std::pair<Operand, Operand>> moves, std::vector<Instruction> &out)
+{
+    moves.erase(std::remove_if(moves.begin(), moves.end(), [](const std::pair<Operand, Operand> &move)
+                               { return move.first == move.second; }),
+                moves.end());
+    while (!moves.empty())
+    {
+        size_t ready = 0;
+        for (; ready < moves.size(); ++ready)
+        {
+            bool blocked = false;
+            for (size_t other = 0; other < moves.size(); ++other)
+                blocked = blocked || (other != ready && moves[other].second == moves[ready].first);
+            if (!blocked)
+                break;
+        }
+
+        if (ready < moves.size())
+        {
+            emitMove(moves[ready].first, moves[ready].second, out);
+            moves.erase(moves.begin() + ready);
+            continue;
+        }
+
+        Operand saved = moves[0].first;
+        emitMove(Operand::reg(0), saved, out);
+        for (auto &move : moves)
+        {
+            if (move.second == saved)
+                move.second = Operand::reg(0);
+        }
+    }
+}
+
+// Emits the CMP or CMPI for a comparison and returns the condition the
+// flags answer, which is mirrored when the operands had to be swapped
+IrOp IrLowering::emitCompare(const IrInstr &instr, std::vector<Instruction> &out)
+{
+    IrOp op = instr.op;
+    IrOperand left = instr.args[0];
+    IrOperand right = instr.args[1];
+    if (left.immediate && right.immediate)
+    {
+        out.push_back({Opcode::LOAD, Operand::reg(0), Operand::imm(evaluateCompare(op, left.value, right.value) ? 1 : 0)});
+        out.push_back({Opcode::CMPI, Operand::reg(0), Operand::imm(0)});
+        return IrOp::Ne;
+    }
+    if (left.immediate)
+    {
+        std::swap(left, right);
+        op = mirror(op);
+    }
+
+    int leftReg = operandRegister(left, 0, out);
+    if (fitsImmediate(right))
+    {
+        out.push_back({Opcode::CMPI, Operand::reg(leftReg), Operand::imm(right.value)});
+        return op;
+    }
+    int rightReg = operandRegister(right, leftReg == 0 ? 7 : 0, out);
+    out.push_back({Opcode::CMP, Operand::reg(leftReg), Operand::reg(rightReg)});
+    return op;
+}
+
+void IrLowering::emitArithmetic(const IrInstr &instr, std::vector<Instruction> &out)
+{
+    static const Opcode registerOps[] = {Opcode::ADD, Opcode::SUB, Opcode::MUL, Opcode::DIV,
+                                         Opcode::SHL, Opcode::SHR, Opcode::SAR, Opcode::AND};
+    static const Opcode immediateOps[] = {Opcode::ADDI, Opcode::SUBI, Opcode::MULI, Opcode::DIVI,
+                                          Opcode::SHLI, Opcode::SHRI, Opcode::SARI, Opcode::ANDI};
+    int which = static_cast<int>(instr.op) - static_cast<int>(IrOp::Add);
+    bool commutative = instr.op == IrOp::Add || instr.op == IrOp::Mul || instr.op == IrOp::And;
+
+    const IrOperand &left = instr.args[0];
+    const IrOperand &right = instr.args[1];
+    int result = target(instr.dst);
+
+    if (fitsImmediate(right))
+    {
+        emitMove(Operand::reg(result), place(left), out);
+        out.push_back({immediateOps[which], Operand::reg(result), Operand::imm(right.value)});
+    }
+    else
+    {
+        int rightReg = operandRegister(right, right.immediate ? 0 : 7, out);
+        if (rightReg != result)
+        {
+            emitMove(Operand::reg(result), place(left), out);
+            out.push_back({registerOps[which], Operand::reg(result), Operand::reg(rightReg)});
+        }
+        else if (commutative)
+        {
+            // The right operand dies here and already sits in the result register
+            int leftReg = operandRegister(left, 0, out);
+            out.push_back({registerOps[which], Operand::reg(result), Operand::reg(leftReg)});
+        }
+        else
+        {
+            emitMove(Operand::reg(0), place(left), out);
+            out.push_back({registerOps[which], Operand::reg(0), Operand::reg(rightReg)});
+            out.push_back({Opcode::MOV, Operand::reg(result), Operand::reg(0)});
+        }
+    }
+    finish(instr.dst, result, out);
+}
+
+void IrLowering::emitBlock(int block, std::vector<Instruction> &out)
+{
+    const std::vector<IrInstr> &instrs = function.blocks[block].instrs;
+    IrOp flags = IrOp::Ne; // what the last fused comparison left in R0
+
+    for (size_t i = 0; i < instrs.size(); ++i)
+    {
+        const IrInstr &instr = instrs[i];
+        switch (instr.op)
+        {
+        case IrOp::Const:
+            emitMove(place(IrOperand::reg(instr.dst)), place(instr.args[0]), out);
+            break;
+        case IrOp::Copy:
+        {
+            std::vector<std::pair<Operand, Operand>> moves;
+            for (; i < instrs.size() && instrs[i].op == IrOp::Copy; ++i)
+                moves.push_back({place(IrOperand::reg(instrs[i].dst)), place(instrs[i].args[0])});
+            --i;
+            emitParallelCopy(std::move(moves), out);
+            break;
+        }
+        case IrOp::Add:
+        case IrOp::Sub:
+        case IrOp::Mul:
+        case IrOp::Div:
+        case IrOp::Shl:
+        case IrOp::Shr:
+        case IrOp::Sar:
+        case IrOp::And:
+            emitArithmetic(instr, out);
+            break;
+        case IrOp::Eq:
+        case IrOp::Ne:
+        case IrOp::Lt:
+        case IrOp::Le:
+        case IrOp::Gt:
+        case IrOp::Ge:
+        {
+            if (fused[instr.dst])
+            {
+                flags = emitCompare(instr, out);
+                break;
+            }
+            int result = target(instr.dst);
+            Operand trueLabel = Operand::label(program.label("cmp_true_" + std::to_string(labelCounter++)));
+            Operand endLabel = Operand::label(program.label("cmp_end_" + std::to_string(labelCounter++)));
+            out.push_back({jumpFor(emitCompare(instr, out), false), trueLabel, {}});
+            out.push_back({Opcode::LOAD, Operand::reg(result), Operand::imm(0)});
+            out.push_back({Opcode::JMP, endLabel, {}});
+            out.push_back({Opcode::LABEL, trueLabel, {}});
+            out.push_back({Opcode::LOAD, Operand::reg(result), Operand::imm(1)});
+            out.push_back({Opcode::LABEL, endLabel, {}});
+            finish(instr.dst, result, out);
+            break;
+        }
+        case IrOp::Print:
+        {
+            int reg = operandRegister(instr.args[0], 0, out);
+            out.push_back({Opcode::PRINT, Operand::reg(reg), {}});
+            break;
+        }
+        case IrOp::PrintString:
+            out.push_back({Opcode::PRINTS, Operand::string(program.string(instr.text)), {}});
+            break;
+        case IrOp::Jump:
+            emitJump(block, instr.targets[0], out);
+            break;
+        case IrOp::Branch:
+        {
+            const IrOperand &condition = instr.args[0];
+            if (condition.immediate)
+            {
+                emitJump(block, instr.targets[condition.value ? 0 : 1], out);
+                break;
+            }
+            if (!fused[condition.value])
+            {
+                int reg = operandRegister(condition, 0, out);
+                out.push_back({Opcode::CMPI, Operand::reg(reg), Operand::imm(0)});
+                flags = IrOp::Ne;
+            }
+            emitBranch(block, flags, instr.targets[0], instr.targets[1], out);
+            break;
+        }
+        case IrOp::Halt:
+            out.push_back({Opcode::HALT, {}, {}});
+            break;
+        case IrOp::Phi:
+            throw std::runtime_error("IR: phi left after leaving SSA");
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef IRLOWER_H
+#define IRLOWER_H
+
+#include "instruction.h"
+#include "ir.h"
+#include "regalloc.h"
+#include <vector>
+
+// Registers IrLowering hands out to virtual registers (R1-R7)
+constexpr int IR_ALLOCATABLE_REGISTERS = 7;
+
+// Turns an SSA IrFunction into assembly for the register VM.
+//  - Phis become parallel copies at the end of each predecessor, which
+//    IrBuilder guarantees has that block as its only successor.
+//  - Virtual registers get R1-R7 by first fit over live ranges with holes,
+//    preferring the register of a copy partner or of the left operand so
+//    the copy or two-address MOV disappears. When that fails, allocation
+//    is redone over R1-R5, moving the values least used inside loops to
+//    memory and keeping R6/R7 to load them.
+//  - R0 is never allocated: CMP overwrites it, and it is the scratch for
+//    wide immediates, print operands and breaking copy cycles.
+//  - A comparison consumed only by the branch right after it becomes
+//    CMP + Jcc; elsewhere it is the CMP/Jcc/LOAD diamond the VM fuses.
+class IrLowering
+{
+public:
+    InstructionBuffer lower(IrFunction function);
+
+private:
+    using Ranges = std::vector<std::pair<int, int>>; // sorted half-open [from, to)
+
+    struct Step
+    {
+        int index;           // uses at 2 * index, definitions at 2 * index + 1
+        std::vector<int> uses;
+        std::vector<int> defs;
+    };
+
+    IrFunction function;
+    std::vector<std::vector<Step>> steps; // per block
+    std::vector<int> blockStart;
+    std::vector<int> blockEnd;
+    std::vector<int> loopDepth;
+    std::vector<bool> fused; // comparisons emitted as part of the next branch
+    std::vector<VariableLocation> locations;
+
+    InstructionBuffer program; // labels and strings; code is filled in last
+    std::vector<bool> referenced;
+    int labelCounter = 0;
+
+    void eliminatePhis();
+    void markFusedCompares();
+    void buildSteps();
+    std::vector<Ranges> computeLiveRanges() const;
+    bool assignLocations(const std::vector<Ranges> &ranges, bool allowSpills);
+
+    Operand place(const IrOperand &operand) const;
+    void emitMove(const Operand &dst, const Operand &src, std::vector<Instruction> &out);
+    int operandRegister(const IrOperand &operand, int scratch, std::vector<Instruction> &out);
+    int target(int vreg) const;
+    void finish(int vreg, int reg, std::vector<Instruction> &out);
+
+    int resolve(int block) const;
+    int fallthrough(int block) const;
+    int label(int block);
+    void emitJump(int block, int to, std::vector<Instruction> &out);
+    void emitBranch(int block, IrOp compare, int ifTrue, int ifFalse, std::vector<Instruction> &out);
+    void emitParallelCopy(std::vector<std::pair<Operand, Operand>> moves, std::vector<Instruction> &out);
+    IrOp emitCompare(const IrInstr &instr, std::vector<Instruction> &out);
+    void emitArithmetic(const IrInstr &instr, std::vector<Instruction> &out);
+    void emitBlock(int block, std::vector<Instruction> &out);
+};
+
+#endif
@@ -0,0 +1,595 @@
+#include "jit.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define ION_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// VM register -> host register. R0-R5 use callee-saved registers so they
+// survive calls into the runtime; R6/R7 are saved around those calls.
+static const int hostRegister[8] = {
+    3,  // R0 -> rbx
+    12, // R1 -> r12
+    13, // R2 -> r13
+    14, // R3 -> r14
+    15, // R4 -> r15
+    5,  // R5 -> rbp
+    10, // R6 -> r10
+    11, // R7 -> r11
+};
+
+// Scratch host registers
+static const int RAX = 0;
+static const int RCX = 1;
+static const int RDX = 2;
+
+// Condition nibble shared by Jcc (0F 8x) and SETcc (0F 9x)
+static uint8_t conditionCode(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::JE:
+    case Opcode::SETE:
+    case Opcode::SETEI:
+        return 0x4;
+    case Opcode::JNE:
+    case Opcode::SETNE:
+    case Opcode::SETNEI:
+        return 0x5;
+    case Opcode::JLT:
+    case Opcode::SETLT:
+    case Opcode::SETLTI:
+        return 0xC;
+    case Opcode::JGE:
+    case Opcode::SETGE:
+    case Opcode::SETGEI:
+        return 0xD;
+    case Opcode::JLE:
+    case Opcode::SETLE:
+    case Opcode::SETLEI:
+        return 0xE;
+    case Opcode::JGT:
+    case Opcode::SETGT:
+    case Opcode::SETGTI:
+        return 0xF;
+    default:
+        throw std::runtime_error("JIT: no condition code for opcode " + std::to_string(static_cast<int>(op)));
+    }
+}
+
+// ModRM reg field selecting the operation of a group 2 shift
+static int shiftExtension(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::SHL:
+    case Opcode::SHLI:
+        return 4;
+    case Opcode::SHR:
+    case Opcode::SHRI:
+        return 5;
+    case Opcode::SAR:
+    case Opcode::SARI:
+        return 7;
+    default:
+        throw std::runtime_error("JIT: not a shift opcode " + std::to_string(static_cast<int>(op)));
+    }
+}
+
+JitCompiler::JitCompiler(const std::vector<DecodedInstruction> &code,
+                         const std::unordered_map<std::string, int> &labels)
+{
+    if (!isSupported())
+        throw std::runtime_error("JIT is only available on x86-64 Linux");
+
+    compile(code);
+    install();
+    writePerfMap(labels);
+}
+
+JitCompiler::~JitCompiler()
+{
+#ifdef ION_JIT_X86_64
+    if (executable)
+        munmap(executable, executableSize);
+#endif
+}
+
+bool JitCompiler::isSupported()
+{
+#ifdef ION_JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+void JitCompiler::emit(std::initializer_list<uint8_t> bytes)
+{
+    buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+}
+
+void JitCompiler::emit32(int32_t value)
+{
+    uint8_t bytes[4];
+    std::memcpy(bytes, &value, 4);
+    buffer.insert(buffer.end(), bytes, bytes + 4);
+}
+
+// <opcode> r/m32, r32 in register-direct form
+void JitCompiler::emitRegReg(uint8_t opcode, int rm, int reg)
+{
+    uint8_t rex = 0x40 | (reg >= 8 ? 0x04 : 0) | (rm >= 8 ? 0x01 : 0);
+    if (rex != 0x40)
+        buffer.push_back(rex);
+    emit({opcode, static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (rm & 7))});
+}
+
+void JitCompiler::emitMovImm(int reg, int32_t value)
+{
+    if (reg >= 8)
+        buffer.push_back(0x41);
+    buffer.push_back(static_cast<uint8_t>(0xB8 + (reg & 7)));
+    emit32(value);
+}
+
+void JitCompiler::emitCmpImm(int reg, int32_t value)
+{
+    if (reg >= 8)
+        buffer.push_back(0x41);
+    emit({0x81, static_cast<uint8_t>(0xF8 | (reg & 7))});
+    emit32(value);
+}
+
+// add/and/sub r32, imm32 (group 1 /0, /4 and /5)
+void JitCompiler::emitArithImm(int extension, int reg, int32_t value)
+{
+    if (reg >= 8)
+        buffer.push_back(0x41);
+    emit({0x81, static_cast<uint8_t>(0xC0 | (extension << 3) | (reg & 7))});
+    emit32(value);
+}
+
+// imul reg, reg, imm32
+void JitCompiler::emitImulImm(int reg, int32_t value)
+{
+    uint8_t rex = 0x40 | (reg >= 8 ? 0x05 : 0);
+    if (rex != 0x40)
+        buffer.push_back(rex);
+    emit({0x69, static_cast<uint8_t>(0xC0 | ((reg & 7) << 3) | (reg & 7))});
+    emit32(value);
+}
+
+// shl/shr/sar r32, cl (group 2 /4, /5 and /7)
+void JitCompiler::emitShift(int extension, int reg)
+{
+    if (reg >= 8)
+        buffer.push_back(0x41);
+    emit({0xD3, static_cast<uint8_t>(0xC0 | (extension << 3) | (reg & 7))});
+}
+
+// shl/shr/sar r32, imm8; the CPU masks the count to five bits like the VM
+void JitCompiler::emitShiftImm(int extension, int reg, int32_t count)
+{
+    if (reg >= 8)
+        buffer.push_back(0x41);
+    emit({0xC1, static_cast<uint8_t>(0xC0 | (extension << 3) | (reg & 7)), static_cast<uint8_t>(count & 31)});
+}
+
+// R0 = (lhs > rhs) - (lhs < rhs) from the flags of the preceding cmp
+void JitCompiler::emitSignToR0()
+{
+    emit({0x0F, 0x9F, 0xC0}); // setg al
+    emit({0x0F, 0x9C, 0xC1}); // setl cl
+    emit({0x0F, 0xB6, 0xC0}); // movzx eax, al
+    emit({0x0F, 0xB6, 0xC9}); // movzx ecx, cl
+    emitRegReg(0x29, RAX, RCX); // sub eax, ecx
+    emitRegReg(0x89, hostRegister[0], RAX);
+}
+
+// Host registers <- frame->registers, with the frame pointer in rdi
+void JitCompiler::emitLoadFrameRegisters()
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        int host = hostRegister[i];
+        if (host >= 8)
+            buffer.push_back(0x44);
+        emit({0x8B, static_cast<uint8_t>(0x40 | ((host & 7) << 3) | 7), static_cast<uint8_t>(4 * i)});
+    }
+}
+
+// frame->registers <- host registers, leaving the frame pointer in rax
+void JitCompiler::emitStoreFrameRegisters()
+{
+    emit({0x48, 0x8B, 0x04, 0x24}); // mov rax, [rsp]
+    for (int i = 0; i < 8; ++i)
+    {
+        int host = hostRegister[i];
+        if (host >= 8)
+            buffer.push_back(0x44);
+        emit({0x89, static_cast<uint8_t>(0x40 | ((host & 7) << 3)), static_cast<uint8_t>(4 * i)});
+    }
+}
+
+// callbacks->fn(callbacks->context, argument), preserving R6/R7
+void JitCompiler::emitCall(size_t callbackOffset, int argumentReg, int32_t argumentImm)
+{
+    emit({0x41, 0x52}); // push r10
+    emit({0x41, 0x53}); // push r11
+    if (argumentReg >= 0)
+    {
+        emitRegReg(0x89, 6, argumentReg); // mov esi, reg
+    }
+    else
+    {
+        buffer.push_back(0xBE); // mov esi, imm32
+        emit32(argumentImm);
+    }
+    emit({0x48, 0x8B, 0x44, 0x24, 0x18}); // mov rax, [rsp + 24] (callbacks)
+    emit({0x48, 0x8B, 0x78, 0x10});       // mov rdi, [rax + 16] (context)
+    emit({0xFF, 0x50, static_cast<uint8_t>(callbackOffset)}); // call [rax + offset]
+    emit({0x41, 0x5B}); // pop r11
+    emit({0x41, 0x5A}); // pop r10
+}
+
+// mov reg, [memory + 4 * address] (8B) or mov [memory + 4 * address], reg (89)
+void JitCompiler::emitMemoryAccess(uint8_t opcode, int reg, int32_t address)
+{
+    emit({0x48, 0x8B, 0x44, 0x24, 0x10}); // mov rax, [rsp + 16] (memory)
+    if (reg >= 8)
+        buffer.push_back(0x44);
+    emit({opcode, static_cast<uint8_t>(0x80 | ((reg & 7) << 3))});
+    emit32(address * 4);
+}
+
+void JitCompiler::compile(const std::vector<DecodedInstruction> &code)
+{
+    struct Fixup
+    {
+        size_t position;
+        int target;
+    };
+    std::vector<Fixup> fixups;
+    std::vector<size_t> exits;
+    std::vector<Fixup> divideFaults; // jz into an exit stub, which reports the dividing instruction
+
+    auto emitJump = [&](uint8_t condition, bool conditional, int target)
+    {
+        if (conditional)
+            emit({0x0F, static_cast<uint8_t>(0x80 | condition)});
+        else
+            buffer.push_back(0xE9);
+        fixups.push_back({buffer.size(), target});
+        emit32(0);
+    };
+
+    auto emitExit = [&](int pc, bool halted, bool divideByZero)
+    {
+        emitStoreFrameRegisters();
+        emit({0xC7, 0x40, 0x20}); // mov dword [rax + 32], pc
+        emit32(pc);
+        emit({0xC7, 0x40, 0x24}); // mov dword [rax + 36], halted
+        emit32(halted ? 1 : 0);
+        if (divideByZero)
+        {
+            emit({0xC7, 0x40, static_cast<uint8_t>(offsetof(JitFrame, divideByZero))}); // mov dword [rax + ...], 1
+            emit32(1);
+        }
+        buffer.push_back(0xE9); // jmp epilogue
+        exits.push_back(buffer.size());
+        emit32(0);
+    };
+
+    // Short forward jump, patched by landShortJump
+    auto emitShortJump = [&](uint8_t opcode)
+    {
+        emit({opcode, 0x00});
+        return buffer.size();
+    };
+    auto landShortJump = [&](size_t position)
+    {
+        buffer[position - 1] = static_cast<uint8_t>(buffer.size() - position);
+    };
+
+    // Matches the VM's DIVIDE: a zero divisor leaves through a fault stub
+    // and -1 negates, since idiv traps on INT_MIN / -1
+    auto emitDivide = [&](int dst, int lhs, int rhs, int pc)
+    {
+        emitRegReg(0x85, rhs, rhs); // test rhs, rhs
+        emit({0x0F, 0x84});         // jz fault stub
+        divideFaults.push_back({buffer.size(), pc});
+        emit32(0);
+
+        emitRegReg(0x89, RAX, lhs); // mov eax, lhs
+        if (rhs >= 8)
+            buffer.push_back(0x41);
+        emit({0x83, static_cast<uint8_t>(0xF8 | (rhs & 7)), 0xFF}); // cmp rhs, -1
+        size_t divide = emitShortJump(0x75);                        // jne divide
+        emit({0xF7, 0xD8});                                         // neg eax
+        size_t done = emitShortJump(0xEB);                          // jmp done
+        landShortJump(divide);
+        buffer.push_back(0x99); // cdq
+        if (rhs >= 8)
+            buffer.push_back(0x41);
+        emit({0xF7, static_cast<uint8_t>(0xF8 | (rhs & 7))}); // idiv rhs
+        landShortJump(done);
+        emitRegReg(0x89, dst, RAX);
+    };
+
+    auto emitImul = [&](int dst, int src)
+    {
+        uint8_t rex = 0x40 | (dst >= 8 ? 0x04 : 0) | (src >= 8 ? 0x01 : 0);
+        if (rex != 0x40)
+            buffer.push_back(rex);
+        emit({0x0F, 0xAF, static_cast<uint8_t>(0xC0 | ((dst & 7) << 3) | (src & 7))});
+    };
+
+    // Prologue: void fn(JitFrame *frame, const JitCallbacks *callbacks, const void *entry)
+    emit({0x55, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57}); // push rbp, rbx, r12-r15
+    emit({0x48, 0x83, 0xEC, 0x18});                                     // sub rsp, 24
+    emit({0x48, 0x89, 0x3C, 0x24});                                     // mov [rsp], rdi
+    emit({0x48, 0x89, 0x74, 0x24, 0x08});                               // mov [rsp + 8], rsi
+    emit({0x48, 0x8B, 0x47, static_cast<uint8_t>(offsetof(JitFrame, memory))}); // mov rax, [rdi + memory]
+    emit({0x48, 0x89, 0x44, 0x24, 0x10});                               // mov [rsp + 16], rax
+    emitLoadFrameRegisters();
+    emit({0xFF, 0xE2}); // jmp rdx
+
+    offsets.assign(code.size(), 0);
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        const DecodedInstruction &instr = code[i];
+        offsets[i] = buffer.size();
+
+        int dst = hostRegister[instr.dst];
+        int src = hostRegister[instr.src & 7];
+        int second = hostRegister[instr.target & 7];
+
+        switch (instr.opcode)
+        {
+        case Opcode::LOAD:
+            emitMovImm(dst, instr.src);
+            break;
+        case Opcode::MOV:
+            emitRegReg(0x89, dst, src);
+            break;
+        case Opcode::ADD:
+            emitRegReg(0x01, dst, src);
+            break;
+        case Opcode::SUB:
+            emitRegReg(0x29, dst, src);
+            break;
+        case Opcode::MUL:
+            emitImul(dst, src);
+            break;
+        case Opcode::DIV:
+            emitDivide(dst, dst, src, static_cast<int>(i));
+            break;
+        case Opcode::CMP:
+            emitRegReg(0x39, dst, src);
+            emitSignToR0();
+            break;
+        case Opcode::CMPI:
+            emitCmpImm(dst, instr.src);
+            emitSignToR0();
+            break;
+        case Opcode::JMP:
+            emitJump(0, false, instr.target);
+            break;
+        case Opcode::JE:
+        case Opcode::JNE:
+        case Opcode::JLT:
+        case Opcode::JGT:
+        case Opcode::JLE:
+        case Opcode::JGE:
+            emitRegReg(0x85, hostRegister[0], hostRegister[0]); // test R0, R0
+            emitJump(conditionCode(instr.opcode), true, instr.target);
+            break;
+        case Opcode::PRINT:
+            emitCall(offsetof(JitCallbacks, printInt), dst, 0);
+            break;
+        case Opcode::PRINTS:
+            emitCall(offsetof(JitCallbacks, printString), -1, instr.target);
+            break;
+        case Opcode::ADDI:
+            emitArithImm(0, dst, instr.src);
+            break;
+        case Opcode::SUBI:
+            emitArithImm(5, dst, instr.src);
+            break;
+        case Opcode::MULI:
+            emitImulImm(dst, instr.src);
+            break;
+        case Opcode::DIVI:
+            emitMovImm(RCX, instr.src);
+            emitDivide(dst, dst, RCX, static_cast<int>(i));
+            break;
+        case Opcode::SHL:
+        case Opcode::SHR:
+        case Opcode::SAR:
+            emitRegReg(0x89, RCX, src); // mov ecx, src
+            emitShift(shiftExtension(instr.opcode), dst);
+            break;
+        case Opcode::AND:
+            emitRegReg(0x21, dst, src);
+            break;
+        case Opcode::SHLI:
+        case Opcode::SHRI:
+        case Opcode::SARI:
+            emitShiftImm(shiftExtension(instr.opcode), dst, instr.src);
+            break;
+        case Opcode::ANDI:
+            emitArithImm(4, dst, instr.src);
+            break;
+        case Opcode::LDM:
+            emitMemoryAccess(0x8B, dst, instr.src);
+            break;
+        case Opcode::STM:
+            emitMemoryAccess(0x89, dst, instr.src);
+            break;
+        case Opcode::HALT:
+            emitExit(static_cast<int>(i) + 1, true, false);
+            break;
+        case Opcode::END:
+            emitExit(static_cast<int>(i), false, false);
+            break;
+        case Opcode::ADD3:
+            emitRegReg(0x89, RAX, src);
+            emitRegReg(0x01, RAX, second);
+            emitRegReg(0x89, dst, RAX);
+            break;
+        case Opcode::SUB3:
+            emitRegReg(0x89, RAX, src);
+            emitRegReg(0x29, RAX, second);
+            emitRegReg(0x89, dst, RAX);
+            break;
+        case Opcode::MUL3:
+            emitRegReg(0x89, RAX, src);
+            emitImul(RAX, second);
+            emitRegReg(0x89, dst, RAX);
+            break;
+        case Opcode::DIV3:
+            emitDivide(dst, src, second, static_cast<int>(i));
+            break;
+        case Opcode::CMPZ_JE:
+            emitCmpImm(dst, 0);
+            emitSignToR0();
+            emitRegReg(0x85, hostRegister[0], hostRegister[0]);
+            emitJump(conditionCode(Opcode::JE), true, instr.target);
+            break;
+        case Opcode::SETE:
+        case Opcode::SETNE:
+        case Opcode::SETLT:
+        case Opcode::SETGT:
+        case Opcode::SETLE:
+        case Opcode::SETGE:
+            emitRegReg(0x39, src, second);
+            emit({0x0F, static_cast<uint8_t>(0x90 | conditionCode(instr.opcode)), 0xC2}); // setcc dl
+            emitSignToR0();
+            emit({0x0F, 0xB6, 0xD2}); // movzx edx, dl
+            emitRegReg(0x89, dst, RDX);
+            break;
+        case Opcode::SETEI:
+        case Opcode::SETNEI:
+        case Opcode::SETLTI:
+        case Opcode::SETGTI:
+        case Opcode::SETLEI:
+        case Opcode::SETGEI:
+            emitCmpImm(src, instr.target);
+            emit({0x0F, static_cast<uint8_t>(0x90 | conditionCode(instr.opcode)), 0xC2}); // setcc dl
+            emitSignToR0();
+            emit({0x0F, 0xB6, 0xD2}); // movzx edx, dl
+            emitRegReg(0x89, dst, RDX);
+            break;
+        case Opcode::DIVP2:
+            emitRegReg(0x89, RAX, src);                 // mov eax, src
+            emitRegReg(0x89, RCX, RAX);                 // mov ecx, eax
+            emitShiftImm(7, RCX, 31);                   // sar ecx, 31
+            emitShiftImm(5, RCX, 32 - instr.target);    // shr ecx, 32 - k
+            emitRegReg(0x01, RAX, RCX);                 // add eax, ecx
+            emitShiftImm(7, RAX, instr.target);         // sar eax, k
+            emitRegReg(0x89, dst, RAX);
+            break;
+        default:
+            throw std::runtime_error("JIT: unsupported opcode " + std::to_string(static_cast<int>(instr.opcode)));
+        }
+    }
+
+    // Division fault stubs, out of line
+    std::vector<size_t> divideStubs;
+    for (const Fixup &fault : divideFaults)
+    {
+        divideStubs.push_back(buffer.size());
+        emitExit(fault.target, false, true);
+    }
+
+    // Epilogue
+    size_t epilogue = buffer.size();
+    emit({0x48, 0x83, 0xC4, 0x18});                         // add rsp, 24
+    emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C}); // pop r15-r12
+    emit({0x5B, 0x5D, 0xC3});                               // pop rbx, rbp; ret
+
+    auto patch = [&](size_t position, size_t destination)
+    {
+        int32_t rel = static_cast<int32_t>(destination - (position + 4));
+        std::memcpy(&buffer[position], &rel, 4);
+    };
+    for (const Fixup &fixup : fixups)
+        patch(fixup.position, offsets[fixup.target]);
+    for (size_t position : exits)
+        patch(position, epilogue);
+    for (size_t k = 0; k < divideFaults.size(); ++k)
+        patch(divideFaults[k].position, divideStubs[k]);
+}
+
+void JitCompiler::install()
+{
+#ifdef ION_JIT_X86_64
+    executableSize = buffer.size();
+    void *memory = mmap(nullptr, executableSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        throw std::runtime_error("JIT: mmap failed");
+
+    std::memcpy(memory, buffer.data(), buffer.size());
+    if (mprotect(memory, executableSize, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, executableSize);
+        throw std::runtime_error("JIT: mprotect failed");
+    }
+    executable = static_cast<uint8_t *>(memory);
+#endif
+}
+
+// perf picks up /tmp/perf-<pid>.map to symbolize samples in JIT'd code;
+// each labeled block gets its own symbol.
+void JitCompiler::writePerfMap(const std::unordered_map<std::string, int> &labels) const
+{
+#ifdef ION_JIT_X86_64
+    std::ofstream out("/tmp/perf-" + std::to_string(getpid()) + ".map", std::ios::app);
+    if (!out)
+        return;
+
+    std::vector<std::pair<size_t, std::string>> blocks;
+    blocks.push_back({0, "ion_jit::entry"});
+    for (const auto &label : labels)
+    {
+        if (label.second < static_cast<int>(offsets.size()))
+            blocks.push_back({offsets[label.second], "ion_jit::" + label.first});
+    }
+    std::sort(blocks.begin(), blocks.end());
+
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        size_t start = blocks[i].first;
+        size_t end = i + 1 < blocks.size() ? blocks[i + 1].first : executableSize;
+        if (end <= start)
+            continue;
+        out << std::hex << reinterpret_cast<uintptr_t>(executable + start) << " " << (end - start)
+            << std::dec << " " << blocks[i].second << "\n";
+    }
+#else
+    (void)labels;
+#endif
+}
+
+void JitCompiler::run(JitFrame &frame, const JitCallbacks &callbacks) const
+{
+#ifdef ION_JIT_X86_64
+    if (frame.pc < 0 || frame.pc >= static_cast<int>(offsets.size()))
+        throw std::runtime_error("JIT: pc out of range");
+
+    using Entry = void (*)(JitFrame *, const JitCallbacks *, const void *);
+    Entry entry = reinterpret_cast<Entry>(executable);
+    entry(&frame, &callbacks, executable + offsets[frame.pc]);
+#else
+    (void)frame;
+    (void)callbacks;
+    throw std::runtime_error("JIT is only available on x86-64 Linux");
+#endif
+}
@@ -0,0 +1,68 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "image.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// VM state handed to and returned from JIT'd code
+struct JitFrame {
+    int32_t registers[8];
+    int32_t pc;
+    int32_t halted;
+    int32_t* memory; // VM data memory for LDM / STM
+    int32_t divideByZero; // set when the instruction at pc divided by zero
+};
+
+// Runtime entry points called from JIT'd code for PRINT / PRINTS
+struct JitCallbacks {
+    void (*printInt)(void *context, int value);
+    void (*printString)(void *context, int stringId);
+    void *context;
+};
+
+// Baseline x86-64 translator for the decoded instruction stream. VM registers
+// R0-R7 live in host registers and every jump becomes a native jump.
+class JitCompiler {
+public:
+    JitCompiler(const std::vector<DecodedInstruction>& code,
+                const std::unordered_map<std::string, int>& labels);
+    ~JitCompiler();
+
+    JitCompiler(const JitCompiler&) = delete;
+    JitCompiler& operator=(const JitCompiler&) = delete;
+
+    // Runs from frame.pc until HALT or the end of the program
+    void run(JitFrame& frame, const JitCallbacks& callbacks) const;
+
+    static bool isSupported();
+
+private:
+    std::vector<uint8_t> buffer;
+    std::vector<size_t> offsets; // instruction index -> offset into buffer
+    uint8_t* executable = nullptr;
+    size_t executableSize = 0;
+
+    void compile(const std::vector<DecodedInstruction>& code);
+    void install();
+    void writePerfMap(const std::unordered_map<std::string, int>& labels) const;
+
+    void emit(std::initializer_list<uint8_t> bytes);
+    void emit32(int32_t value);
+    void emitRegReg(uint8_t opcode, int rm, int reg);
+    void emitMovImm(int reg, int32_t value);
+    void emitCmpImm(int reg, int32_t value);
+    void emitArithImm(int extension, int reg, int32_t value);
+    void emitImulImm(int reg, int32_t value);
+    void emitShift(int extension, int reg);
+    void emitShiftImm(int extension, int reg, int32_t count);
+    void emitSignToR0();
+    void emitLoadFrameRegisters();
+    void emitStoreFrameRegisters();
+    void emitCall(size_t callbackOffset, int argumentReg, int32_t argumentImm);
+    void emitMemoryAccess(uint8_t opcode, int reg, int32_t address);
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include "licm.h"
+#include "irlower.h"
+#include <algorithm>
+
+// Registers left for values computed and consumed within one iteration
+static const int TEMPORARY_RESERVE = 2;
+
+void LoopInvariantMotion::run(IrFunction &function)
+{
+    std::vector<std::pair<int, int>> loops; // header, latch
+    for (const IrBlock &block : function.blocks)
+    {
+        for (int target : block.instrs.back().targets)
+        {
+            if (target <= block.id)
+                loops.push_back({target, block.id});
+        }
+    }
+    std::stable_sort(loops.begin(), loops.end(), [](const std::pair<int, int> &a, const std::pair<int, int> &b)
+                     { return a.second - a.first < b.second - b.first; });
+
+    for (const auto &loop : loops)
+        hoistFrom(function, loop.first, loop.second);
+}
+
+void LoopInvariantMotion::hoistFrom(IrFunction &function, int header, int latch)
+{
+    int preheader = function.blocks[header].preds[0];
+    if (preheader >= header || function.blocks[preheader].instrs.back().op != IrOp::Jump)
+        return;
+
+    // Pressure is the number of values live on entry to the header, which
+    // stay in registers for the whole loop. Reads inside the loop are
+    // counted to tell when hoisting takes the last of them away; a phi
+    // reads at the end of the predecessor its value comes from.
+    size_t valueCount = function.types.size();
+    std::vector<std::vector<bool>> liveIn = computeLiveIn(function);
+    std::vector<bool> liveAfter(valueCount, false);
+    std::vector<int> uses(valueCount, 0);
+    std::vector<int> loopUses(valueCount, 0);
+    std::vector<const IrInstr *> definition(valueCount, nullptr); // inside the loop
+    for (const IrBlock &block : function.blocks)
+    {
+        bool inLoop = block.id >= header && block.id <= latch;
+        for (const IrInstr &instr : block.instrs)
+        {
+            if (instr.dst >= 0 && inLoop)
+                definition[instr.dst] = &instr;
+            for (size_t i = 0; i < instr.args.size(); ++i)
+            {
+                if (instr.args[i].immediate)
+                    continue;
+                int at = instr.op == IrOp::Phi ? block.preds[i] : block.id;
+                ++uses[instr.args[i].value];
+                if (at >= header && at <= latch)
+                    ++loopUses[instr.args[i].value];
+            }
+            for (int target : instr.targets)
+            {
+                if (!inLoop || (target >= header && target <= latch))
+                    continue;
+                for (size_t v = 0; v < valueCount; ++v)
+                    liveAfter[v] = liveAfter[v] || liveIn[target][v];
+            }
+        }
+    }
+    int pressure = static_cast<int>(std::count(liveIn[header].begin(), liveIn[header].end(), true));
+
+    // Invariant values, in layout order, which puts definitions first
+    std::vector<bool> invariant(valueCount, false);
+    std::vector<int> order;
+    for (int b = header; b <= latch; ++b)
+    {
+        const std::vector<IrInstr> &instrs = function.blocks[b].instrs;
+        for (size_t i = 0; i < instrs.size(); ++i)
+        {
+            const IrInstr &instr = instrs[i];
+            bool candidate = instr.op == IrOp::Const || instr.op == IrOp::Add || instr.op == IrOp::Sub ||
+                             instr.op == IrOp::Mul || isCompare(instr.op) ||
+                             (instr.op == IrOp::Div && instr.args[1].immediate && instr.args[1].value != 0);
+            if (candidate && isCompare(instr.op) && uses[instr.dst] == 1 && i + 1 < instrs.size() &&
+                instrs[i + 1].op == IrOp::Branch && instrs[i + 1].args[0] == IrOperand::reg(instr.dst))
+                candidate = false;
+            for (const IrOperand &arg : instr.args)
+                candidate = candidate && (arg.immediate || !definition[arg.value] || invariant[arg.value]);
+            if (candidate)
+            {
+                invariant[instr.dst] = true;
+                order.push_back(instr.dst);
+            }
+        }
+    }
+
+    // Each invariant value is tried together with whatever part of its
+    // expression is still in the loop: (a < b) + b / 3 leaves one value
+    // live through the loop, though its parts alone would leave three.
+    std::vector<bool> hoisted(valueCount, false);
+    std::vector<IrInstr> &hoistTo = function.blocks[preheader].instrs;
+    for (int root : order)
+    {
+        if (hoisted[root])
+            continue;
+
+        std::vector<int> tree; // operands before their users
+        std::vector<bool> inTree(valueCount, false);
+        std::vector<std::pair<int, size_t>> stack = {{root, 0}};
+        inTree[root] = true;
+        while (!stack.empty())
+        {
+            int value = stack.back().first;
+            const std::vector<IrOperand> &args = definition[value]->args;
+            if (stack.back().second == args.size())
+            {
+                tree.push_back(value);
+                stack.pop_back();
+                continue;
+            }
+            const IrOperand &arg = args[stack.back().second++];
+            if (!arg.immediate && invariant[arg.value] && !hoisted[arg.value] && !inTree[arg.value])
+            {
+                inTree[arg.value] = true;
+                stack.push_back({arg.value, 0});
+            }
+        }
+
+        std::vector<int> touched;
+        for (int value : tree)
+        {
+            for (const IrOperand &arg : definition[value]->args)
+            {
+                if (!arg.immediate)
+                {
+                    --loopUses[arg.value];
+                    touched.push_back(arg.value);
+                }
+            }
+        }
+        int delta = 0;
+        for (int value : tree)
+            delta += loopUses[value] > 0 || liveAfter[value];
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (int value : touched)
+        {
+            if (!inTree[value] && loopUses[value] == 0 && !liveAfter[value])
+                --delta; // its last reads in the loop were in the tree
+        }
+
+        if (delta > 0 && pressure + delta + TEMPORARY_RESERVE > IR_ALLOCATABLE_REGISTERS)
+        {
+            for (int value : tree)
+            {
+                for (const IrOperand &arg : definition[value]->args)
+                {
+                    if (!arg.immediate)
+                        ++loopUses[arg.value];
+                }
+            }
+            continue;
+        }
+
+        pressure += delta;
+        for (int value : tree)
+        {
+            hoisted[value] = true;
+            hoistTo.insert(hoistTo.end() - 1, *definition[value]);
+        }
+    }
+
+    for (int b = header; b <= latch; ++b)
+    {
+        std::vector<IrInstr> &instrs = function.blocks[b].instrs;
+        instrs.erase(std::remove_if(instrs.begin(), instrs.end(), [&](const IrInstr &instr)
+                                    { return instr.dst >= 0 && hoisted[instr.dst]; }),
+                     instrs.end());
+    }
+}
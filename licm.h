@@ -0,0 +1,32 @@
+#ifndef LICM_H
+#define LICM_H
+
+#include "ir.h"
+#include <vector>
+
+// Loop-invariant code motion over IrBuilder's output. A loop is the
+// contiguous run of blocks from a header to the block that jumps back to
+// it; its preheader is the header's first predecessor, whose code ends just
+// before the while label. Inner loops are processed first, so a value can
+// climb out of several levels.
+//
+// An instruction is invariant when every register it reads is defined
+// outside the loop. Arithmetic, constants and comparisons used as values
+// are hoisted; a division only when its divisor is a non-zero immediate, so
+// running it when the loop body would not have cannot fault. A comparison
+// that only feeds the branch after it stays, as it costs nothing extra
+// there.
+//
+// Every hoisted value occupies a register for the whole loop. A hoist that
+// adds to the values live through the loop is only made while those, plus
+// a reserve for the body's own temporaries, fit the allocatable registers.
+class LoopInvariantMotion
+{
+public:
+    void run(IrFunction &function);
+
+private:
+    void hoistFrom(IrFunction &function, int header, int latch);
+};
+
+#endif
@@ -1,24 +1,16 @@
+#include <algorithm>
+#include <charconv>
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include "tokenizer.h"
-#include "parser.h"
-#include "codegen.h"
+#include <thread>
+#include "compiler.h"
+#include "batch.h"
+#include "cache.h"
 #include "binarygen.h"
 #include "bin2asm.h"
 #include "vm.h"
 
-std::string readFile(const std::string &filename)
-{
-    std::ifstream inFile(filename);
-    if (!inFile)
-        throw std::runtime_error("Could not open source file: " + filename);
-
-    std::stringstream buffer;
-    buffer << inFile.rdbuf();
-    return buffer.str();
-}
-
 void writeFile(const std::string &filename, const std::vector<std::string> &lines)
 {
     std::ofstream outFile(filename);
@@ -29,25 +21,23 @@ void writeFile(const std::string &filename, const std::vector<std::string> &line
         outFile << line << "\n";
 }
 
-std::vector<std::string> readAssembly(const std::string &filename)
+void writeBinaryFile(const std::string &filename, const std::vector<uint8_t> &bytes)
 {
-    std::ifstream inFile(filename);
-    if (!inFile)
-        throw std::runtime_error("Could not open assembly file: " + filename);
-
-    std::vector<std::string> lines;
-    std::string line;
-    while (std::getline(inFile, line))
-    {
-        if (!line.empty())
-            lines.push_back(line);
-    }
-    return lines;
+    std::ofstream outFile(filename, std::ios::binary);
+    if (!outFile)
+        throw std::runtime_error("Could not write to file: " + filename);
+    outFile.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
 }
 
-bool hasSBSuffix(const std::string &filename)
+// Parses a positive count for a numeric option; digits only, and out of
+// range values are rejected rather than wrapped
+uint64_t parseCount(const std::string &option, const std::string &value)
 {
-    return filename.size() >= 3 && filename.substr(filename.size() - 3) == ".sb";
+    uint64_t count = 0;
+    auto result = std::from_chars(value.data(), value.data() + value.size(), count);
+    if (result.ec != std::errc() || result.ptr != value.data() + value.size() || count == 0)
+        throw std::runtime_error(option + " expects a positive number");
+    return count;
 }
 
 void writeBinaryAsBitLines(const std::string &binFilename, const std::string &txtFilename);
@@ -56,13 +46,144 @@ int main(int argc, char *argv[])
 {
     try
     {
-        if (argc < 2)
+        std::string inputFile;
+        std::string engine = "binary";
+        std::string dispatch = "threaded";
+        bool fusion = true;
+        bool jit = false;
+        std::string outputMode = "buffered";
+        bool profile = false;
+        std::string profileJson;
+        std::string snapshotIn;
+        std::string snapshotOut;
+        std::string batchFile;
+        std::string jobCount;
+        std::string quantum;
+        uint64_t maxInstructions = 0;
+        int optimizationLevel = 1;
+        bool peepholeStats = false;
+        bool emitIr = false;
+        bool emitAsm = false;
+        bool useCache = true;
+        int unrollFactor = LoopUnroller::DEFAULT_FACTOR;
+
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg.rfind("--engine=", 0) == 0)
+                engine = arg.substr(9);
+            else if (arg.rfind("--dispatch=", 0) == 0)
+                dispatch = arg.substr(11);
+            else if (arg == "--no-fuse")
+                fusion = false;
+            else if (arg == "--jit")
+                jit = true;
+            else if (arg.rfind("--output=", 0) == 0)
+                outputMode = arg.substr(9);
+            else if (arg == "--profile")
+                profile = true;
+            else if (arg.rfind("--profile-json=", 0) == 0)
+            {
+                profile = true;
+                profileJson = arg.substr(15);
+            }
+            else if (arg.rfind("--snapshot-in=", 0) == 0)
+                snapshotIn = arg.substr(14);
+            else if (arg.rfind("--snapshot-out=", 0) == 0)
+                snapshotOut = arg.substr(15);
+            else if (arg.rfind("--max-instructions=", 0) == 0)
+                maxInstructions = parseCount("--max-instructions", arg.substr(19));
+            else if (arg.rfind("--quantum=", 0) == 0)
+                quantum = arg.substr(10);
+            else if (arg == "-O0" || arg == "-O1")
+                optimizationLevel = arg[2] - '0';
+            else if (arg == "--peephole-stats")
+                peepholeStats = true;
+            else if (arg == "--emit-ir")
+                emitIr = true;
+            else if (arg == "--emit-asm")
+                emitAsm = true;
+            else if (arg == "--no-cache")
+                useCache = false;
+            else if (arg.rfind("--unroll=", 0) == 0)
+            {
+                // No loop takes more copies than the unroller's statement budget
+                uint64_t factor = parseCount("--unroll", arg.substr(9));
+                unrollFactor = static_cast<int>(
+                    std::min<uint64_t>(factor, LoopUnroller::MAX_UNROLLED_STATEMENTS));
+            }
+            else if (arg == "--batch" && i + 1 < argc)
+                batchFile = argv[++i];
+            else if (arg == "-j" && i + 1 < argc)
+                jobCount = argv[++i];
+            else if (arg.rfind("-j", 0) == 0 && arg.size() > 2)
+                jobCount = arg.substr(2);
+            else
+                inputFile = arg;
+        }
+
+        if (!batchFile.empty())
+        {
+            size_t threads = std::thread::hardware_concurrency();
+            if (!jobCount.empty())
+                threads = parseCount("-j", jobCount);
+
+            BatchRunner batch(threads);
+            if (!quantum.empty())
+                batch.setQuantum(parseCount("--quantum", quantum));
+            batch.setInstructionLimit(maxInstructions);
+            batch.setOptimizationLevel(optimizationLevel);
+            CompileCache cache(useCache ? CompileCache::defaultDirectory() : "");
+            batch.setCache(&cache);
+            batch.loadJobs(batchFile);
+            size_t failures = batch.run();
+            batch.writeOutput(std::cout, std::cerr);
+            batch.writeReport(std::cerr);
+            return failures == 0 ? 0 : 1;
+        }
+
+        if (inputFile.empty())
+        {
+            std::cerr << "Usage: " << argv[0] << " [--engine=text|binary] [--dispatch=threaded|switch] [--no-fuse] [--jit] [-O0|-O1] [--unroll=N] [--peephole-stats] [--emit-ir] [--emit-asm] [--no-cache] [--output=buffered|async] [--profile] [--profile-json=file] [--snapshot-in=file] [--snapshot-out=file] [--max-instructions=N] <source_file.sb>\n";
+            std::cerr << "       " << argv[0] << " --batch <jobs.txt> [-j N] [--quantum=N] [--max-instructions=N] [-O0|-O1] [--no-cache]\n";
+            return 1;
+        }
+
+        if (engine != "text" && engine != "binary")
+        {
+            std::cerr << "Error: Unknown engine '" << engine << "' (expected text or binary).\n";
+            return 1;
+        }
+
+        if (dispatch != "threaded" && dispatch != "switch")
+        {
+            std::cerr << "Error: Unknown dispatch '" << dispatch << "' (expected threaded or switch).\n";
+            return 1;
+        }
+
+        if (outputMode != "buffered" && outputMode != "async")
         {
-            std::cerr << "Usage: " << argv[0] << " <source_file.sb>\n";
+            std::cerr << "Error: Unknown output mode '" << outputMode << "' (expected buffered or async).\n";
             return 1;
         }
 
-        std::string inputFile = argv[1];
+        if (profile && jit)
+        {
+            std::cerr << "Error: --profile is not supported with --jit.\n";
+            return 1;
+        }
+
+        if (maxInstructions && jit)
+        {
+            std::cerr << "Error: --max-instructions is not supported with --jit.\n";
+            return 1;
+        }
+
+        if (emitIr && optimizationLevel < 1)
+        {
+            std::cerr << "Error: --emit-ir needs -O1; -O0 does not build the IR.\n";
+            return 1;
+        }
 
         // ✅ Enforce .sb extension
         if (!hasSBSuffix(inputFile))
@@ -71,38 +192,97 @@ int main(int argc, char *argv[])
             return 1;
         }
 
-        std::string asmFile = "program.asm";
-
         std::string code = readFile(inputFile);
 
-        Tokenizer tokenizer(code);
-        std::vector<Token> tokens = tokenizer.tokenize();
-
-        Parser parser(tokens);
-        std::vector<std::unique_ptr<Stmt>> ast = parser.parse();
-
-        CodeGenerator generator;
-        std::vector<std::string> asmCode = generator.generate(ast);
+        PeepholeStats stats;
+        std::ofstream irFile;
+        CompileOptions options;
+        options.optimizationLevel = optimizationLevel;
+        options.unrollFactor = unrollFactor;
+        options.peepholeStats = &stats;
+        if (emitIr)
+        {
+            irFile.open("program.ir");
+            if (!irFile)
+                throw std::runtime_error("Could not write to file: program.ir");
+            options.irDump = &irFile;
+        }
+        // A cache hit skips the compiler, so it only serves runs that need
+        // nothing but the bytecode
+        CompileCache cache(useCache ? CompileCache::defaultDirectory() : "");
+        std::string cacheKey = CompileCache::key(code, options);
+        bool needsCompiler = engine == "text" || emitAsm || emitIr || peepholeStats;
+        InstructionBuffer program;
+        std::vector<uint8_t> bytecode;
+        if (needsCompiler || !cache.load(cacheKey, code, bytecode))
+        {
+            program = compileSource(code, options);
+            if (peepholeStats)
+                stats.write(std::cerr);
 
-        writeFile(asmFile, asmCode);
+            BinaryGenerator binGen;
+            bytecode = binGen.encode(program);
+            cache.store(cacheKey, code, bytecode);
+        }
+        writeBinaryFile("program.bin", bytecode);
 
-        BinaryGenerator binGen;
-        binGen.generateBinary(asmCode, "program.bin");
+        // The text listings are only for reading, so they are opt-in
+        if (emitAsm)
+        {
+            writeFile("program.asm", program.toAssembly());
+            writeBinaryAsBitLines("program.bin", "program_bits.txt");
 
-        writeBinaryAsBitLines("program.bin", "program_bits.txt");
+            BinToAsmConverter reconvert;
+            reconvert.convert("program_bits.txt", "reconstructed.asm");
+        }
 
-        BinToAsmConverter reconvert;
-        reconvert.convert("program_bits.txt", "reconstructed.asm");
+        std::unique_ptr<OutputSink> asyncOutput;
+        if (outputMode == "async")
+            asyncOutput = std::make_unique<AsyncOutputSink>(1);
 
-        std::vector<std::string> loadedAssembly = readAssembly(asmFile);
         VirtualMachine vm;
-        vm.loadProgram(loadedAssembly);
-        vm.run();
+        vm.setFusion(fusion);
+        vm.setOutput(asyncOutput.get());
+        vm.setProfiling(profile);
+        if (engine == "binary")
+        {
+            vm.loadBinary(bytecode);
+        }
+        else
+        {
+            vm.loadProgram(program);
+        }
+        if (!snapshotIn.empty())
+            vm.loadSnapshot(snapshotIn);
+        if (maxInstructions)
+        {
+            StepStatus status = vm.step(maxInstructions);
+            if (status == StepStatus::Faulted)
+                throw std::runtime_error(vm.faultMessage());
+            if (status == StepStatus::Yielded)
+            {
+                // With --snapshot-out this is a checkpoint rather than a failure
+                if (snapshotOut.empty())
+                    throw std::runtime_error("Instruction limit of " + std::to_string(maxInstructions) + " exceeded");
+                std::cerr << "Stopped after " << vm.retiredInstructions() << " instructions; state saved to " << snapshotOut << "\n";
+            }
+        }
+        else if (jit)
+            vm.runJit();
+        else if (dispatch == "switch")
+            vm.runSwitch();
+        else
+            vm.run();
 
-        // std::vector<std::string> reconstructedAsm = readAssembly("reconstructed.asm");
-        // VirtualMachine vm2;
-        // vm2.loadProgram(reconstructedAsm);
-        // vm2.run();
+        if (!snapshotOut.empty())
+            vm.saveSnapshot(snapshotOut);
+
+        if (profile)
+        {
+            vm.writeProfileReport(std::cerr);
+            if (!profileJson.empty())
+                vm.writeProfileJson(profileJson);
+        }
     }
     catch (const std::exception &e)
     {
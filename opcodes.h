@@ -0,0 +1,146 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <cstdint>
+
+// Opcode bytes of the program.bin format (see bytecode.h), kept in sync
+// with BinToAsmConverter::decodeInstruction.
+enum class Opcode : uint8_t
+{
+    LOAD = 0x01,
+    MOV = 0x02,
+    ADD = 0x03,
+    SUB = 0x04,
+    MUL = 0x05,
+    DIV = 0x06,
+    CMP = 0x07,
+    JMP = 0x08,
+    JE = 0x09,
+    JNE = 0x0A,
+    JLT = 0x0B,
+    JGT = 0x0C,
+    JLE = 0x0D,
+    JGE = 0x0E,
+    PRINTS = 0x0F,
+    HALT = 0x10,
+    PRINT = 0x11,
+    LDM = 0x12, // LDM Rd, addr: Rd = memory[addr]
+    STM = 0x13, // STM Rs, addr: memory[addr] = Rs
+    ADDI = 0x14, // ADDI Rd, imm: Rd += imm
+    SUBI = 0x15,
+    MULI = 0x16,
+    DIVI = 0x17,
+    CMPI = 0x18, // CMPI Rs, imm: R0 = sign(Rs - imm)
+    SHL = 0x19,  // SHL Rd, Rs: Rd <<= Rs & 31
+    SHR = 0x1A,  // logical: zeros shift in
+    SAR = 0x1B,  // arithmetic: copies of the sign bit shift in
+    AND = 0x1C,
+    SHLI = 0x1D, // SHLI Rd, imm: Rd <<= imm & 31
+    SHRI = 0x1E,
+    SARI = 0x1F,
+    ANDI = 0x20,
+    DATA = 0xFD,  // assembler directives; only version 1 writes them to program.bin
+    LABEL = 0xFE,
+
+    // VM-internal, appended by the loaders and never written to program.bin
+    END = 0x81, // sentinel appended after the last instruction
+
+    // Superinstructions formed by the loader's fusion pass
+    ADD3 = 0x82, // MOV t, a / ADD t, b
+    SUB3 = 0x83,
+    MUL3 = 0x84,
+    DIV3 = 0x85,
+    CMPZ_JE = 0x86, // CMP r, 0 / JE label
+    SETE = 0x87,    // CMP a, b / Jcc / LOAD t, 0 / JMP / LOAD t, 1
+    SETNE = 0x88,
+    SETLT = 0x89,
+    SETGT = 0x8A,
+    SETLE = 0x8B,
+    SETGE = 0x8C,
+    SETEI = 0x8D,   // CMPI a, imm / Jcc / LOAD t, 0 / JMP / LOAD t, 1
+    SETNEI = 0x8E,
+    SETLTI = 0x8F,
+    SETGTI = 0x90,
+    SETLEI = 0x91,
+    SETGEI = 0x92,
+    DIVP2 = 0x93    // MOV t, a / SARI t, 31 / SHRI t, 32 - k / ADD t, a / SARI t, k
+};
+
+inline const char *opcodeName(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::LOAD: return "LOAD";
+    case Opcode::MOV: return "MOV";
+    case Opcode::ADD: return "ADD";
+    case Opcode::SUB: return "SUB";
+    case Opcode::MUL: return "MUL";
+    case Opcode::DIV: return "DIV";
+    case Opcode::CMP: return "CMP";
+    case Opcode::JMP: return "JMP";
+    case Opcode::JE: return "JE";
+    case Opcode::JNE: return "JNE";
+    case Opcode::JLT: return "JLT";
+    case Opcode::JGT: return "JGT";
+    case Opcode::JLE: return "JLE";
+    case Opcode::JGE: return "JGE";
+    case Opcode::PRINTS: return "PRINTS";
+    case Opcode::HALT: return "HALT";
+    case Opcode::PRINT: return "PRINT";
+    case Opcode::LDM: return "LDM";
+    case Opcode::STM: return "STM";
+    case Opcode::ADDI: return "ADDI";
+    case Opcode::SUBI: return "SUBI";
+    case Opcode::MULI: return "MULI";
+    case Opcode::DIVI: return "DIVI";
+    case Opcode::CMPI: return "CMPI";
+    case Opcode::SHL: return "SHL";
+    case Opcode::SHR: return "SHR";
+    case Opcode::SAR: return "SAR";
+    case Opcode::AND: return "AND";
+    case Opcode::SHLI: return "SHLI";
+    case Opcode::SHRI: return "SHRI";
+    case Opcode::SARI: return "SARI";
+    case Opcode::ANDI: return "ANDI";
+    case Opcode::DATA: return "DATA";
+    case Opcode::LABEL: return "LABEL";
+    case Opcode::END: return "END";
+    case Opcode::ADD3: return "ADD3";
+    case Opcode::SUB3: return "SUB3";
+    case Opcode::MUL3: return "MUL3";
+    case Opcode::DIV3: return "DIV3";
+    case Opcode::CMPZ_JE: return "CMPZ_JE";
+    case Opcode::SETE: return "SETE";
+    case Opcode::SETNE: return "SETNE";
+    case Opcode::SETLT: return "SETLT";
+    case Opcode::SETGT: return "SETGT";
+    case Opcode::SETLE: return "SETLE";
+    case Opcode::SETGE: return "SETGE";
+    case Opcode::SETEI: return "SETEI";
+    case Opcode::SETNEI: return "SETNEI";
+    case Opcode::SETLTI: return "SETLTI";
+    case Opcode::SETGTI: return "SETGTI";
+    case Opcode::SETLEI: return "SETLEI";
+    case Opcode::SETGEI: return "SETGEI";
+    case Opcode::DIVP2: return "DIVP2";
+    }
+    return "UNKNOWN";
+}
+
+// Byte 3 of a version 1 CMP word: set when the second operand is a
+// register rather than an immediate.
+constexpr uint8_t CMP_REGISTER_OPERAND = 0x01;
+
+// Words of VM data memory
+constexpr int VM_MEMORY_SIZE = 1024;
+
+// ADDI..CMPI and SHLI..ANDI take any 32-bit immediate
+constexpr int IMMEDIATE_MIN = INT32_MIN;
+constexpr int IMMEDIATE_MAX = INT32_MAX;
+
+inline bool hasImmediateOperand(Opcode op)
+{
+    return (op >= Opcode::ADDI && op <= Opcode::CMPI) || (op >= Opcode::SHLI && op <= Opcode::ANDI);
+}
+
+#endif
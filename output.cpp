@@ -0,0 +1,176 @@
+#include "output.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+void writeAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::string("Output write failed: ") + std::strerror(errno));
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+void OutputSink::writeLine(const std::string &text)
+{
+    writeLine(text.data(), text.size());
+}
+
+void OutputSink::writeInt(int value)
+{
+    char digits[16];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    writeLine(digits, static_cast<size_t>(result.ptr - digits));
+}
+
+// === FdOutputSink ===
+
+FdOutputSink::FdOutputSink(int fd, size_t capacity) : fd(fd), capacity(capacity) {}
+
+FdOutputSink::~FdOutputSink()
+{
+    try
+    {
+        flush();
+    }
+    catch (...)
+    {
+        // nothing sensible to do with a failed write during teardown
+    }
+}
+
+void FdOutputSink::writeLine(const char *data, size_t size)
+{
+    // allocated on first use so idle VMs do not each carry a buffer
+    if (buffer.empty())
+        buffer.resize(capacity);
+
+    if (used + size + 1 > buffer.size())
+    {
+        flush();
+        if (size + 1 > buffer.size())
+        {
+            // larger than the whole buffer: write through
+            writeAll(fd, data, size);
+            writeAll(fd, "\n", 1);
+            return;
+        }
+    }
+
+    std::memcpy(buffer.data() + used, data, size);
+    used += size;
+    buffer[used++] = '\n';
+}
+
+void FdOutputSink::flush()
+{
+    if (used == 0)
+        return;
+    size_t pending = used;
+    used = 0;
+    writeAll(fd, buffer.data(), pending);
+}
+
+// === MemoryOutputSink ===
+
+void MemoryOutputSink::writeLine(const char *data, size_t size)
+{
+    text.append(data, size);
+    text.push_back('\n');
+}
+
+// === AsyncOutputSink ===
+
+static size_t roundUpToPowerOfTwo(size_t value)
+{
+    size_t result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+AsyncOutputSink::AsyncOutputSink(int fd, size_t capacity)
+    : fd(fd), ring(roundUpToPowerOfTwo(capacity < 2 ? 2 : capacity)), mask(ring.size() - 1)
+{
+    writer = std::thread(&AsyncOutputSink::drain, this);
+}
+
+AsyncOutputSink::~AsyncOutputSink()
+{
+    flush();
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+}
+
+void AsyncOutputSink::push(const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t free = ring.size() - (h - tail.load(std::memory_order_acquire));
+        if (free == 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        size_t chunk = std::min({size, free, ring.size() - (h & mask)});
+        std::memcpy(ring.data() + (h & mask), data, chunk);
+        head.store(h + chunk, std::memory_order_release);
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void AsyncOutputSink::writeLine(const char *data, size_t size)
+{
+    push(data, size);
+    push("\n", 1);
+}
+
+void AsyncOutputSink::flush()
+{
+    while (tail.load(std::memory_order_acquire) != head.load(std::memory_order_acquire))
+        std::this_thread::yield();
+}
+
+void AsyncOutputSink::drain()
+{
+    for (;;)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+
+        if (t == h)
+        {
+            if (stopping.load(std::memory_order_acquire) && tail.load() == head.load())
+                return;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+
+        // write the contiguous run up to the end of the ring
+        size_t chunk = std::min(h - t, ring.size() - (t & mask));
+        try
+        {
+            writeAll(fd, ring.data() + (t & mask), chunk);
+        }
+        catch (...)
+        {
+            // drop output we cannot deliver rather than wedging the producer
+        }
+        tail.store(t + chunk, std::memory_order_release);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <cstddef>
+
+// Destination for PRINT / PRINTS. Sinks receive whole lines without the
+// trailing newline and are responsible for adding it.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    virtual void writeLine(const char* data, size_t size) = 0;
+    virtual void flush() {}
+
+    void writeLine(const std::string& text);
+    void writeInt(int value);
+};
+
+// Buffers output for a file descriptor and writes it when the buffer fills
+// or on flush().
+class FdOutputSink : public OutputSink {
+public:
+    explicit FdOutputSink(int fd = 1, size_t capacity = 64 * 1024);
+    ~FdOutputSink() override;
+
+    void writeLine(const char* data, size_t size) override;
+    void flush() override;
+
+private:
+    int fd;
+    size_t capacity;
+    std::vector<char> buffer;
+    size_t used = 0;
+};
+
+// Captures output in memory, for embedding and tests.
+class MemoryOutputSink : public OutputSink {
+public:
+    void writeLine(const char* data, size_t size) override;
+
+    const std::string& contents() const { return text; }
+    void clear() { text.clear(); }
+
+private:
+    std::string text;
+};
+
+// Hands lines to a writer thread through a lock-free single-producer,
+// single-consumer byte ring. Only one thread may write to the sink.
+class AsyncOutputSink : public OutputSink {
+public:
+    explicit AsyncOutputSink(int fd = 1, size_t capacity = 1 << 20);
+    ~AsyncOutputSink() override;
+
+    void writeLine(const char* data, size_t size) override;
+    // Blocks until the writer thread has drained the ring
+    void flush() override;
+
+private:
+    int fd;
+    std::vector<char> ring;
+    size_t mask;
+    std::atomic<size_t> head{0}; // written by the producer
+    std::atomic<size_t> tail{0}; // written by the writer thread
+    std::atomic<bool> stopping{false};
+    std::thread writer;
+
+    void push(const char* data, size_t size);
+    void drain();
+};
+
+// write(2) until everything is out or the descriptor fails
+void writeAll(int fd, const char* data, size_t size);
+
+#endif
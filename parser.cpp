@@ -222,6 +222,13 @@ unique_ptr<Expr> Parser::primary()
         return std::make_unique<StringLiteralExpr>(previous().lexeme);
     }
 
+    if (match({TokenType::LPAREN}))
+    {
+        std::unique_ptr<Expr> expr = expression();
+        consume(TokenType::RPAREN, "Expected ')' after expression.");
+        return expr;
+    }
+
     throw runtime_error("Expected expression.");
 }
 
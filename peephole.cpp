@@ -0,0 +1,311 @@
+#include "peephole.h"
+#include <iomanip>
+#include <unordered_set>
+
+static const char *RULE_NAMES[] = {"self-move", "move-round-trip", "dead-load", "jump-to-next", "unused-label", "unreachable"};
+
+const char *peepholeRuleName(PeepholeRule rule)
+{
+    return RULE_NAMES[static_cast<int>(rule)];
+}
+
+void PeepholeStats::add(const PeepholeStats &other)
+{
+    for (int rule = 0; rule < static_cast<int>(PeepholeRule::Count); ++rule)
+        hits[rule] += other.hits[rule];
+}
+
+void PeepholeStats::write(std::ostream &out) const
+{
+    out << "-- peephole --\n";
+    for (int rule = 0; rule < static_cast<int>(PeepholeRule::Count); ++rule)
+        out << "  " << std::left << std::setw(16) << RULE_NAMES[rule] << std::right << std::setw(10) << hits[rule] << "\n";
+}
+
+namespace
+{
+    bool isConditionalJump(Opcode op)
+    {
+        return op == Opcode::JE || op == Opcode::JNE || op == Opcode::JLT || op == Opcode::JGT ||
+               op == Opcode::JLE || op == Opcode::JGE;
+    }
+
+    bool isJump(Opcode op)
+    {
+        return op == Opcode::JMP || isConditionalJump(op);
+    }
+
+    // Control may enter or leave here, so straight-line reasoning stops
+    bool endsBlock(const Instruction &instr)
+    {
+        return instr.opcode == Opcode::LABEL || instr.opcode == Opcode::HALT || instr.opcode == Opcode::DATA ||
+               isJump(instr.opcode);
+    }
+
+    bool writes(const Instruction &instr, const Operand &reg)
+    {
+        switch (instr.opcode)
+        {
+        case Opcode::CMP:
+        case Opcode::CMPI:
+            return reg == Operand::reg(0);
+        case Opcode::LOAD:
+        case Opcode::MOV:
+        case Opcode::LDM:
+        case Opcode::ADD:
+        case Opcode::SUB:
+        case Opcode::MUL:
+        case Opcode::DIV:
+        case Opcode::ADDI:
+        case Opcode::SUBI:
+        case Opcode::MULI:
+        case Opcode::DIVI:
+        case Opcode::SHL:
+        case Opcode::SHR:
+        case Opcode::SAR:
+        case Opcode::AND:
+        case Opcode::SHLI:
+        case Opcode::SHRI:
+        case Opcode::SARI:
+        case Opcode::ANDI:
+            return instr.a == reg;
+        default:
+            return false;
+        }
+    }
+
+    bool reads(const Instruction &instr, const Operand &reg)
+    {
+        Opcode op = instr.opcode;
+        if (op == Opcode::LOAD || op == Opcode::LDM || op == Opcode::LABEL || op == Opcode::DATA ||
+            op == Opcode::JMP || op == Opcode::PRINTS || op == Opcode::HALT)
+            return false;
+        if (isConditionalJump(op))
+            return reg == Operand::reg(0);
+        if (op == Opcode::MOV)
+            return instr.b == reg;
+        return instr.a == reg || instr.b == reg;
+    }
+
+    std::unordered_set<int> jumpTargets(const std::vector<Instruction> &code)
+    {
+        std::unordered_set<int> targets;
+        for (const Instruction &instr : code)
+        {
+            if (isJump(instr.opcode))
+                targets.insert(instr.a.value);
+        }
+        return targets;
+    }
+
+    void eraseMarked(std::vector<Instruction> &code, const std::vector<bool> &removed)
+    {
+        std::vector<Instruction> kept;
+        kept.reserve(code.size());
+        for (size_t i = 0; i < code.size(); ++i)
+        {
+            if (!removed[i])
+                kept.push_back(code[i]);
+        }
+        code = std::move(kept);
+    }
+}
+
+PeepholeOptimizer::PeepholeOptimizer(size_t window) : window(window)
+{
+    for (bool &rule : enabled)
+        rule = true;
+}
+
+void PeepholeOptimizer::setRuleEnabled(PeepholeRule rule, bool value)
+{
+    enabled[static_cast<int>(rule)] = value;
+}
+
+InstructionBuffer PeepholeOptimizer::optimize(InstructionBuffer program)
+{
+    std::vector<Instruction> &code = program.code;
+
+    // Removing a jump can orphan a label, and removing a label can put a
+    // jump right before its target, so repeat until nothing changes
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        if (isEnabled(PeepholeRule::SelfMove))
+            changed |= removeSelfMoves(code);
+        if (isEnabled(PeepholeRule::MoveRoundTrip))
+            changed |= removeMoveRoundTrips(code);
+        if (isEnabled(PeepholeRule::DeadLoad))
+            changed |= removeDeadLoads(code);
+        if (isEnabled(PeepholeRule::JumpToNext))
+            changed |= removeJumpsToNext(code);
+        if (isEnabled(PeepholeRule::UnusedLabel))
+            changed |= removeUnusedLabels(code);
+        if (isEnabled(PeepholeRule::Unreachable))
+            changed |= removeUnreachable(code);
+    }
+    return program;
+}
+
+bool PeepholeOptimizer::removeSelfMoves(std::vector<Instruction> &code)
+{
+    std::vector<Instruction> kept;
+    kept.reserve(code.size());
+    for (const Instruction &instr : code)
+    {
+        if (instr.opcode == Opcode::MOV && instr.a == instr.b)
+        {
+            hit(PeepholeRule::SelfMove);
+            continue;
+        }
+        kept.push_back(instr);
+    }
+    bool changed = kept.size() != code.size();
+    code = std::move(kept);
+    return changed;
+}
+
+// After MOV a, b the two registers agree until one of them is written, so
+// a MOV b, a or a repeated MOV a, b in that stretch changes nothing
+bool PeepholeOptimizer::removeMoveRoundTrips(std::vector<Instruction> &code)
+{
+    std::vector<bool> removed(code.size(), false);
+    bool changed = false;
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        const Instruction &first = code[i];
+        if (removed[i] || first.opcode != Opcode::MOV || first.a == first.b)
+            continue;
+
+        for (size_t j = i + 1; j < code.size() && j <= i + window; ++j)
+        {
+            if (removed[j])
+                continue;
+            const Instruction &line = code[j];
+            if (line.opcode == Opcode::MOV && ((line.a == first.b && line.b == first.a) || (line.a == first.a && line.b == first.b)))
+            {
+                removed[j] = true;
+                changed = true;
+                hit(PeepholeRule::MoveRoundTrip);
+                break;
+            }
+            if (endsBlock(line) || writes(line, first.a) || writes(line, first.b))
+                break;
+        }
+    }
+
+    if (changed)
+        eraseMarked(code, removed);
+    return changed;
+}
+
+bool PeepholeOptimizer::removeDeadLoads(std::vector<Instruction> &code)
+{
+    std::vector<bool> removed(code.size(), false);
+    bool changed = false;
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        const Instruction &load = code[i];
+        if (load.opcode != Opcode::LOAD || !load.a.isRegister())
+            continue;
+
+        for (size_t j = i + 1; j < code.size() && j <= i + window; ++j)
+        {
+            const Instruction &line = code[j];
+            if (endsBlock(line) || reads(line, load.a))
+                break;
+            if (writes(line, load.a))
+            {
+                removed[i] = true;
+                changed = true;
+                hit(PeepholeRule::DeadLoad);
+                break;
+            }
+        }
+    }
+
+    if (changed)
+        eraseMarked(code, removed);
+    return changed;
+}
+
+bool PeepholeOptimizer::removeJumpsToNext(std::vector<Instruction> &code)
+{
+    std::vector<Instruction> kept;
+    kept.reserve(code.size());
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        const Instruction &line = code[i];
+        bool toNext = false;
+        if (isJump(line.opcode))
+        {
+            for (size_t j = i + 1; j < code.size(); ++j)
+            {
+                const Instruction &next = code[j];
+                if (next.opcode != Opcode::LABEL)
+                    break;
+                if (next.a == line.a)
+                {
+                    toNext = true;
+                    break;
+                }
+            }
+        }
+
+        if (toNext)
+            hit(PeepholeRule::JumpToNext);
+        else
+            kept.push_back(code[i]);
+    }
+    bool changed = kept.size() != code.size();
+    code = std::move(kept);
+    return changed;
+}
+
+bool PeepholeOptimizer::removeUnusedLabels(std::vector<Instruction> &code)
+{
+    std::unordered_set<int> targets = jumpTargets(code);
+
+    std::vector<Instruction> kept;
+    kept.reserve(code.size());
+    for (const Instruction &instr : code)
+    {
+        if (instr.opcode == Opcode::LABEL && !targets.count(instr.a.value))
+        {
+            hit(PeepholeRule::UnusedLabel);
+            continue;
+        }
+        kept.push_back(instr);
+    }
+    bool changed = kept.size() != code.size();
+    code = std::move(kept);
+    return changed;
+}
+
+// Nothing falls through a JMP, so only a jump can reach the code after it.
+// DATA lines are not executed and stay where they are.
+bool PeepholeOptimizer::removeUnreachable(std::vector<Instruction> &code)
+{
+    std::unordered_set<int> targets = jumpTargets(code);
+
+    std::vector<Instruction> kept;
+    kept.reserve(code.size());
+    bool reachable = true;
+    for (const Instruction &instr : code)
+    {
+        if (instr.opcode == Opcode::LABEL && targets.count(instr.a.value))
+            reachable = true;
+
+        if (reachable || instr.opcode == Opcode::DATA)
+            kept.push_back(instr);
+        else
+            hit(PeepholeRule::Unreachable);
+
+        if (instr.opcode == Opcode::JMP)
+            reachable = false;
+    }
+    bool changed = kept.size() != code.size();
+    code = std::move(kept);
+    return changed;
+}
@@ -0,0 +1,62 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "instruction.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+enum class PeepholeRule {
+    SelfMove,      // MOV R1, R1
+    MoveRoundTrip, // MOV a, b ... MOV b, a (or MOV a, b again)
+    DeadLoad,      // LOAD r, k overwritten before r is read
+    JumpToNext,    // JMP / Jcc to a label that directly follows
+    UnusedLabel,   // LABEL no jump refers to
+    Unreachable,   // code between a JMP and the next referenced LABEL
+    Count
+};
+
+const char* peepholeRuleName(PeepholeRule rule);
+
+// Number of times each rule removed an instruction
+struct PeepholeStats {
+    uint64_t hits[static_cast<int>(PeepholeRule::Count)] = {};
+
+    void add(const PeepholeStats& other);
+    void write(std::ostream& out) const;
+};
+
+// Rewrites the instructions CodeGenerator emits, before it reaches the
+// BinaryGenerator or the VM. Rules that look ahead only follow straight-line
+// code, never past a LABEL or a jump, and at most `window` instructions.
+class PeepholeOptimizer {
+public:
+    static const size_t DEFAULT_WINDOW = 4;
+
+    explicit PeepholeOptimizer(size_t window = DEFAULT_WINDOW);
+
+    void setRuleEnabled(PeepholeRule rule, bool enabled);
+
+    // Applies the enabled rules until none of them fires
+    InstructionBuffer optimize(InstructionBuffer program);
+
+    const PeepholeStats& stats() const { return counters; }
+
+private:
+    size_t window;
+    bool enabled[static_cast<int>(PeepholeRule::Count)];
+    PeepholeStats counters;
+
+    bool isEnabled(PeepholeRule rule) const { return enabled[static_cast<int>(rule)]; }
+    void hit(PeepholeRule rule) { ++counters.hits[static_cast<int>(rule)]; }
+
+    bool removeSelfMoves(std::vector<Instruction>& code);
+    bool removeMoveRoundTrips(std::vector<Instruction>& code);
+    bool removeDeadLoads(std::vector<Instruction>& code);
+    bool removeJumpsToNext(std::vector<Instruction>& code);
+    bool removeUnusedLabels(std::vector<Instruction>& code);
+    bool removeUnreachable(std::vector<Instruction>& code);
+};
+
+#endif
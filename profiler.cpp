@@ -0,0 +1,218 @@
+#include "profiler.h"
+#include "image.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+static const size_t HOT_PC_LIMIT = 20;
+
+void Profiler::prepare(size_t programSize)
+{
+    if (hits.size() != programSize)
+    {
+        hits.assign(programSize, 0);
+        taken.assign(programSize, 0);
+    }
+}
+
+static bool isConditional(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::JE:
+    case Opcode::JNE:
+    case Opcode::JLT:
+    case Opcode::JGT:
+    case Opcode::JLE:
+    case Opcode::JGE:
+    case Opcode::CMPZ_JE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+Profiler::Summary Profiler::summarize(const std::vector<DecodedInstruction> &code,
+                                      const std::unordered_map<std::string, int> &labels) const
+{
+    Summary summary;
+    const int size = static_cast<int>(std::min(code.size(), hits.size()));
+
+    // Label names by position; the smallest name wins when several share one
+    std::vector<std::string> labelAt(code.size() + 1);
+    for (const auto &label : labels)
+    {
+        std::string &name = labelAt[label.second];
+        if (name.empty() || label.first < name)
+            name = label.first;
+    }
+
+    summary.locations.resize(size);
+    std::string current = "entry";
+    int currentStart = 0;
+    for (int pc = 0; pc < size; ++pc)
+    {
+        if (!labelAt[pc].empty())
+        {
+            current = labelAt[pc];
+            currentStart = pc;
+        }
+        summary.locations[pc] = pc == currentStart ? current : current + "+" + std::to_string(pc - currentStart);
+    }
+
+    std::map<std::string, uint64_t> perOpcode;
+    for (int pc = 0; pc < size; ++pc)
+    {
+        const DecodedInstruction &instr = code[pc];
+        if (instr.opcode == Opcode::END || hits[pc] == 0)
+            continue;
+
+        summary.executed += hits[pc];
+        summary.original += hits[pc] * instr.width;
+        perOpcode[opcodeName(instr.opcode)] += hits[pc];
+        summary.hotPcs.push_back(pc);
+
+        bool jump = instr.opcode == Opcode::JMP || isConditional(instr.opcode);
+        if (!jump)
+            continue;
+
+        std::string target = labelAt[instr.target].empty() ? "pc " + std::to_string(instr.target) : labelAt[instr.target];
+
+        if (isConditional(instr.opcode))
+        {
+            summary.branches.push_back({pc, opcodeName(instr.opcode), summary.locations[pc], target,
+                                        taken[pc], hits[pc] - taken[pc]});
+        }
+
+        // A taken jump to an earlier pc closes a loop
+        if (instr.target <= pc && taken[pc] > 0)
+            summary.loops.push_back({target, instr.target, pc, taken[pc]});
+    }
+
+    for (const auto &entry : perOpcode)
+        summary.opcodes.push_back({entry.first, entry.second});
+    std::sort(summary.opcodes.begin(), summary.opcodes.end(), [](const OpcodeCount &a, const OpcodeCount &b)
+              { return a.count != b.count ? a.count > b.count : a.name < b.name; });
+
+    std::stable_sort(summary.hotPcs.begin(), summary.hotPcs.end(), [&](int a, int b)
+                     { return hits[a] > hits[b]; });
+    if (summary.hotPcs.size() > HOT_PC_LIMIT)
+        summary.hotPcs.resize(HOT_PC_LIMIT);
+
+    std::stable_sort(summary.branches.begin(), summary.branches.end(), [](const Branch &a, const Branch &b)
+                     { return a.taken + a.notTaken > b.taken + b.notTaken; });
+    std::stable_sort(summary.loops.begin(), summary.loops.end(), [](const Loop &a, const Loop &b)
+                     { return a.iterations > b.iterations; });
+
+    return summary;
+}
+
+static std::string percent(uint64_t part, uint64_t whole)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << (whole ? 100.0 * part / whole : 0.0) << "%";
+    return out.str();
+}
+
+void Profiler::writeReport(std::ostream &out, const std::vector<DecodedInstruction> &code,
+                           const std::unordered_map<std::string, int> &labels) const
+{
+    Summary summary = summarize(code, labels);
+
+    out << "=== Ion profile ===\n";
+    out << "dispatched records:    " << summary.executed << "\n";
+    out << "unfused instructions:  " << summary.original << "\n";
+
+    out << "\n-- opcodes --\n";
+    for (const OpcodeCount &op : summary.opcodes)
+    {
+        out << "  " << std::left << std::setw(10) << op.name << std::right << std::setw(14) << op.count
+            << "  " << percent(op.count, summary.executed) << "\n";
+    }
+
+    out << "\n-- hot pcs --\n";
+    for (int pc : summary.hotPcs)
+    {
+        out << "  pc " << std::setw(5) << pc << "  " << std::left << std::setw(10) << opcodeName(code[pc].opcode)
+            << std::right << std::setw(14) << hits[pc] << "  " << summary.locations[pc] << "\n";
+    }
+
+    out << "\n-- conditional branches --\n";
+    for (const Branch &branch : summary.branches)
+    {
+        out << "  pc " << std::setw(5) << branch.pc << "  " << std::left << std::setw(8) << branch.opcode << std::right
+            << " -> " << branch.target << "  taken " << branch.taken << ", not taken " << branch.notTaken
+            << "  (" << branch.location << ")\n";
+    }
+
+    out << "\n-- loops --\n";
+    for (const Loop &loop : summary.loops)
+    {
+        out << "  " << std::left << std::setw(20) << loop.label << std::right << std::setw(14) << loop.iterations
+            << " back-edges  (pc " << loop.latch << " -> " << loop.head << ")\n";
+    }
+}
+
+static std::string jsonString(const std::string &text)
+{
+    std::string escaped = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+void Profiler::writeJson(const std::string &filename, const std::vector<DecodedInstruction> &code,
+                         const std::unordered_map<std::string, int> &labels) const
+{
+    std::ofstream out(filename);
+    if (!out)
+        throw std::runtime_error("Could not write profile: " + filename);
+
+    Summary summary = summarize(code, labels);
+
+    out << "{\n  \"dispatched\": " << summary.executed << ",\n";
+    out << "  \"unfused_instructions\": " << summary.original << ",\n";
+
+    out << "  \"opcodes\": {";
+    for (size_t i = 0; i < summary.opcodes.size(); ++i)
+        out << (i ? ", " : "") << jsonString(summary.opcodes[i].name) << ": " << summary.opcodes[i].count;
+    out << "},\n";
+
+    out << "  \"pcs\": [";
+    bool first = true;
+    for (size_t pc = 0; pc < summary.locations.size(); ++pc)
+    {
+        if (hits[pc] == 0 || code[pc].opcode == Opcode::END)
+            continue;
+        out << (first ? "\n" : ",\n") << "    {\"pc\": " << pc << ", \"opcode\": " << jsonString(opcodeName(code[pc].opcode))
+            << ", \"location\": " << jsonString(summary.locations[pc]) << ", \"hits\": " << hits[pc] << "}";
+        first = false;
+    }
+    out << "\n  ],\n";
+
+    out << "  \"branches\": [";
+    for (size_t i = 0; i < summary.branches.size(); ++i)
+    {
+        const Branch &branch = summary.branches[i];
+        out << (i ? ",\n" : "\n") << "    {\"pc\": " << branch.pc << ", \"opcode\": " << jsonString(branch.opcode)
+            << ", \"target\": " << jsonString(branch.target) << ", \"taken\": " << branch.taken
+            << ", \"not_taken\": " << branch.notTaken << "}";
+    }
+    out << "\n  ],\n";
+
+    out << "  \"loops\": [";
+    for (size_t i = 0; i < summary.loops.size(); ++i)
+    {
+        const Loop &loop = summary.loops[i];
+        out << (i ? ",\n" : "\n") << "    {\"label\": " << jsonString(loop.label) << ", \"head\": " << loop.head
+            << ", \"latch\": " << loop.latch << ", \"iterations\": " << loop.iterations << "}";
+    }
+    out << "\n  ]\n}\n";
+}
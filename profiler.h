@@ -0,0 +1,62 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct DecodedInstruction;
+
+// Execution counters filled in by VirtualMachine's profiling dispatch loop:
+// hits per pc and, for jumps, how often the jump was taken.
+class Profiler {
+public:
+    // Sizes the counters for a program; counts survive repeated runs
+    void prepare(size_t programSize);
+    uint64_t* hitCounts() { return hits.data(); }
+    uint64_t* takenCounts() { return taken.data(); }
+
+    void writeReport(std::ostream& out, const std::vector<DecodedInstruction>& code,
+                     const std::unordered_map<std::string, int>& labels) const;
+    void writeJson(const std::string& filename, const std::vector<DecodedInstruction>& code,
+                   const std::unordered_map<std::string, int>& labels) const;
+
+private:
+    std::vector<uint64_t> hits;
+    std::vector<uint64_t> taken;
+
+    struct OpcodeCount {
+        std::string name;
+        uint64_t count;
+    };
+    struct Branch {
+        int pc;
+        std::string opcode;
+        std::string location;
+        std::string target;
+        uint64_t taken;
+        uint64_t notTaken;
+    };
+    struct Loop {
+        std::string label;
+        int head;
+        int latch;
+        uint64_t iterations;
+    };
+    struct Summary {
+        uint64_t executed = 0;
+        uint64_t original = 0; // executed instructions counted before fusion
+        std::vector<OpcodeCount> opcodes;
+        std::vector<int> hotPcs;
+        std::vector<Branch> branches;
+        std::vector<Loop> loops;
+        std::vector<std::string> locations; // pc -> "label+offset"
+    };
+
+    Summary summarize(const std::vector<DecodedInstruction>& code,
+                      const std::unordered_map<std::string, int>& labels) const;
+};
+
+#endif
@@ -1,10 +1,5 @@
-LOAD R1, 1
-MOV R0, R1
+LOAD R0, 1
 PRINT R0
-MOV R6, R1
-LOAD R7, 1
-MOV R1, R6
-ADD R1, R7
-MOV R0, R1
+LOAD R0, 2
 PRINT R0
 HALT
@@ -0,0 +1,213 @@
+#include "regalloc.h"
+#include <algorithm>
+#include <stdexcept>
+
+RegisterAllocator::RegisterAllocator(int firstRegister, int lastRegister, int memorySlots)
+    : firstRegister(firstRegister), lastRegister(lastRegister), memorySlots(memorySlots) {}
+
+void RegisterAllocator::reference(const std::string &name, int at, bool definition)
+{
+    auto &refs = references[name];
+    if (refs.empty())
+        order.push_back(name);
+    refs.push_back({at, currentLoop, definition && ifDepth == 0});
+}
+
+void RegisterAllocator::walkExpr(Expr *expr, int at)
+{
+    if (expr->type == ExprType::VARIABLE)
+    {
+        reference(static_cast<VariableExpr *>(expr)->name, at, false);
+    }
+    else if (expr->type == ExprType::BINARY)
+    {
+        auto *bin = static_cast<BinaryExpr *>(expr);
+        walkExpr(bin->left.get(), at);
+        walkExpr(bin->right.get(), at);
+    }
+}
+
+void RegisterAllocator::walkBlock(const std::vector<std::unique_ptr<Stmt>> &block)
+{
+    for (const auto &stmt : block)
+        walkStmt(stmt.get());
+}
+
+void RegisterAllocator::walkStmt(Stmt *stmt)
+{
+    int at = point++;
+
+    if (stmt->type == StmtType::VAR_DECL)
+    {
+        // The value is read before the variable is written
+        auto *decl = static_cast<VarDeclStmt *>(stmt);
+        walkExpr(decl->initializer.get(), at);
+        reference(decl->varName, at, true);
+    }
+    else if (stmt->type == StmtType::ASSIGN)
+    {
+        auto *assign = static_cast<AssignStmt *>(stmt);
+        walkExpr(assign->value.get(), at);
+        reference(assign->varName, at, true);
+    }
+    else if (stmt->type == StmtType::PRINT)
+    {
+        walkExpr(static_cast<PrintStmt *>(stmt)->expression.get(), at);
+    }
+    else if (stmt->type == StmtType::IF)
+    {
+        auto *ifStmt = static_cast<IfStmt *>(stmt);
+        walkExpr(ifStmt->condition.get(), at);
+
+        ++ifDepth;
+        walkBlock(ifStmt->thenBranch);
+        if (ifStmt->elseIfStmt)
+            walkStmt(ifStmt->elseIfStmt.get());
+        else
+            walkBlock(ifStmt->elseBranch);
+        --ifDepth;
+    }
+    else if (stmt->type == StmtType::WHILE)
+    {
+        auto *loop = static_cast<WhileStmt *>(stmt);
+        int index = static_cast<int>(loops.size());
+        loops.push_back({at, 0, currentLoop});
+
+        int savedLoop = currentLoop;
+        int savedIfDepth = ifDepth;
+        currentLoop = index;
+        ifDepth = 0;
+
+        walkExpr(loop->condition.get(), at);
+        walkBlock(loop->body);
+        loops[index].end = point++;
+
+        currentLoop = savedLoop;
+        ifDepth = savedIfDepth;
+    }
+}
+
+bool RegisterAllocator::insideLoop(int loop, int ancestor) const
+{
+    for (; loop >= 0; loop = loops[loop].parent)
+    {
+        if (loop == ancestor)
+            return true;
+    }
+    return false;
+}
+
+RegisterAllocator::Interval RegisterAllocator::buildInterval(const std::string &name) const
+{
+    const std::vector<Reference> &refs = references.at(name);
+    const Reference &first = refs.front();
+
+    Interval interval{name, first.point, refs.back().point, first.definite};
+
+    // A variable that may be read before it is written must keep the zero
+    // it starts with, so its register cannot be shared with anything earlier.
+    // A definition inside a loop only counts while every reference stays in
+    // that loop; otherwise a zero-trip loop would expose a stale register.
+    int localLoop = -1;
+    if (first.definite && first.loop >= 0)
+    {
+        bool contained = std::all_of(refs.begin(), refs.end(), [&](const Reference &ref)
+                                     { return insideLoop(ref.loop, first.loop); });
+        if (contained)
+            localLoop = first.loop;
+        else
+            interval.startsAtDef = false;
+    }
+    if (!interval.startsAtDef)
+        interval.start = 0;
+
+    // Live across a back edge: cover the whole loop. Loops that enclose the
+    // defining loop of a loop-local variable are exempt, since the variable is
+    // redefined before use on every trip.
+    for (int loop = 0; loop < static_cast<int>(loops.size()); ++loop)
+    {
+        if (localLoop >= 0 && insideLoop(localLoop, loop))
+            continue;
+        bool used = std::any_of(refs.begin(), refs.end(), [&](const Reference &ref)
+                                { return insideLoop(ref.loop, loop); });
+        if (!used)
+            continue;
+        interval.start = std::min(interval.start, loops[loop].start);
+        interval.end = std::max(interval.end, loops[loop].end);
+        if (interval.start < first.point)
+            interval.startsAtDef = false;
+    }
+    return interval;
+}
+
+std::unordered_map<std::string, VariableLocation> RegisterAllocator::allocate(const std::vector<std::unique_ptr<Stmt>> &program)
+{
+    walkBlock(program);
+
+    std::vector<Interval> intervals;
+    for (const std::string &name : order)
+        intervals.push_back(buildInterval(name));
+    std::stable_sort(intervals.begin(), intervals.end(), [](const Interval &a, const Interval &b)
+                     { return a.start < b.start; });
+
+    std::unordered_map<std::string, VariableLocation> locations;
+    std::vector<int> freeRegisters;
+    for (int reg = lastRegister; reg >= firstRegister; --reg)
+        freeRegisters.push_back(reg);
+    std::vector<const Interval *> active; // sorted by increasing end
+    int nextSlot = 0;
+
+    auto spill = [&](const std::string &name)
+    {
+        if (nextSlot >= memorySlots)
+            throw std::runtime_error("Too many variables to spill: " + name);
+        locations[name] = {-1, nextSlot++};
+    };
+
+    for (const Interval &interval : intervals)
+    {
+        // Expire intervals that are dead by now. One whose last use is this
+        // statement can hand its register over when this statement defines
+        // the new variable, because the right-hand side is read first.
+        while (!active.empty())
+        {
+            const Interval *oldest = active.front();
+            bool dead = oldest->end < interval.start ||
+                        (oldest->end == interval.start && interval.startsAtDef);
+            if (!dead)
+                break;
+            freeRegisters.push_back(locations[oldest->name].reg);
+            active.erase(active.begin());
+        }
+
+        auto insertActive = [&](const Interval *entry)
+        {
+            auto position = std::upper_bound(active.begin(), active.end(), entry, [](const Interval *a, const Interval *b)
+                                             { return a->end < b->end; });
+            active.insert(position, entry);
+        };
+
+        if (!freeRegisters.empty())
+        {
+            locations[interval.name] = {freeRegisters.back(), -1};
+            freeRegisters.pop_back();
+            insertActive(&interval);
+            continue;
+        }
+
+        // Out of registers: spill whichever live interval ends last
+        const Interval *last = active.back();
+        if (last->end > interval.end)
+        {
+            locations[interval.name] = {locations[last->name].reg, -1};
+            spill(last->name);
+            active.pop_back();
+            insertActive(&interval);
+        }
+        else
+        {
+            spill(interval.name);
+        }
+    }
+    return locations;
+}
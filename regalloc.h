@@ -0,0 +1,69 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "ast.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Where a variable lives for its whole lifetime
+struct VariableLocation {
+    int reg = -1;  // register number, or -1 when spilled
+    int slot = -1; // VM memory address when spilled
+
+    bool spilled() const { return reg < 0; }
+};
+
+// Linear-scan register allocation over the AST. Every statement is one
+// program point; a variable's live interval runs from its definition to its
+// last use and is stretched over any loop whose back edge it is live across.
+// Intervals that do not fit in [firstRegister, lastRegister] are spilled to
+// VM memory addresses [0, memorySlots), choosing the one whose interval
+// ends last.
+class RegisterAllocator {
+public:
+    RegisterAllocator(int firstRegister, int lastRegister, int memorySlots);
+
+    std::unordered_map<std::string, VariableLocation> allocate(const std::vector<std::unique_ptr<Stmt>>& program);
+
+private:
+    struct Loop {
+        int start; // point of the while statement (the condition)
+        int end;   // point of the back edge
+        int parent;
+    };
+
+    struct Reference {
+        int point;
+        int loop; // innermost enclosing loop, -1 at top level
+        bool definite; // a definition that runs before any use it reaches
+    };
+
+    struct Interval {
+        std::string name;
+        int start;
+        int end;
+        bool startsAtDef;
+    };
+
+    int firstRegister;
+    int lastRegister;
+    int memorySlots;
+
+    int point = 0;
+    int currentLoop = -1;
+    int ifDepth = 0; // conditional nesting inside the innermost loop
+    std::vector<Loop> loops;
+    std::unordered_map<std::string, std::vector<Reference>> references;
+    std::vector<std::string> order; // first-reference order, for determinism
+
+    void walkBlock(const std::vector<std::unique_ptr<Stmt>>& block);
+    void walkStmt(Stmt* stmt);
+    void walkExpr(Expr* expr, int at);
+    void reference(const std::string& name, int at, bool definition);
+
+    bool insideLoop(int loop, int ancestor) const;
+    Interval buildInterval(const std::string& name) const;
+};
+
+#endif
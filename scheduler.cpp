@@ -0,0 +1,105 @@
+#include "scheduler.h"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+Scheduler::Scheduler(size_t threads, uint64_t quantum)
+    : threads(threads == 0 ? 1 : threads), quantum(quantum == 0 ? 1 : quantum) {}
+
+size_t Scheduler::add(VirtualMachine *vm, uint64_t instructionLimit)
+{
+    if (!vm)
+        throw std::runtime_error("Cannot schedule a null VM");
+
+    Task task;
+    task.vm = vm;
+    task.limit = instructionLimit;
+    tasks.push_back(task);
+    return tasks.size() - 1;
+}
+
+void Scheduler::run()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        runQueue.clear();
+        active = 0;
+        for (size_t id = 0; id < tasks.size(); ++id)
+        {
+            if (tasks[id].state == TaskState::Runnable)
+            {
+                runQueue.push_back(id);
+                ++active;
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    size_t count = std::min(threads, std::max<size_t>(active, 1));
+    for (size_t i = 0; i < count; ++i)
+        workers.emplace_back(&Scheduler::workerLoop, this);
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void Scheduler::runSlice(Task &task)
+{
+    VirtualMachine &vm = *task.vm;
+    uint64_t slice = quantum;
+    if (task.limit)
+        slice = std::min(slice, task.limit - std::min(task.limit, vm.retiredInstructions()));
+
+    ++task.slices;
+    switch (vm.step(slice))
+    {
+    case StepStatus::Halted:
+        task.state = TaskState::Halted;
+        break;
+    case StepStatus::Faulted:
+        task.state = TaskState::Faulted;
+        task.error = vm.faultMessage();
+        break;
+    case StepStatus::Yielded:
+        if (task.limit && vm.retiredInstructions() >= task.limit)
+        {
+            task.state = TaskState::LimitExceeded;
+            task.error = "Instruction limit of " + std::to_string(task.limit) + " exceeded";
+        }
+        break;
+    }
+}
+
+void Scheduler::workerLoop()
+{
+    for (;;)
+    {
+        size_t id;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this]
+                       { return !runQueue.empty() || active == 0; });
+            if (runQueue.empty())
+                return;
+            id = runQueue.front();
+            runQueue.pop_front();
+        }
+
+        // Only the worker holding the id touches the task or its VM
+        Task &task = tasks[id];
+        runSlice(task);
+
+        bool requeued = task.state == TaskState::Runnable;
+        bool allDone = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (requeued)
+                runQueue.push_back(id);
+            else
+                allDone = --active == 0;
+        }
+        if (requeued)
+            ready.notify_one();
+        else if (allDone)
+            ready.notify_all();
+    }
+}
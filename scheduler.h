@@ -0,0 +1,57 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "vm.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Multiplexes many VirtualMachines over a fixed set of worker threads.
+// Runnable VMs wait in one FIFO queue; a worker takes the oldest, runs it
+// for one quantum with step(), and requeues it at the back if it yielded.
+class Scheduler {
+public:
+    enum class TaskState {
+        Runnable,
+        Halted,
+        Faulted,
+        LimitExceeded // hit its total instruction limit
+    };
+
+    struct Task {
+        VirtualMachine* vm;
+        uint64_t limit; // total instructions allowed, 0 for unlimited
+        TaskState state = TaskState::Runnable;
+        uint64_t slices = 0;
+        std::string error;
+    };
+
+    Scheduler(size_t threads, uint64_t quantum);
+
+    // The VM must have a program loaded and outlive run(). Returns the task id.
+    size_t add(VirtualMachine* vm, uint64_t instructionLimit = 0);
+
+    // Runs every task to completion on the worker threads
+    void run();
+
+    const Task& task(size_t id) const { return tasks[id]; }
+    size_t taskCount() const { return tasks.size(); }
+
+private:
+    size_t threads;
+    uint64_t quantum;
+    std::vector<Task> tasks;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<size_t> runQueue;
+    size_t active = 0; // tasks not yet finished
+
+    void workerLoop();
+    void runSlice(Task& task);
+};
+
+#endif
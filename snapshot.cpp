@@ -0,0 +1,49 @@
+#include "snapshot.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<VmSnapshot>::value, "VmSnapshot must stay plain data");
+
+static const char SNAPSHOT_MAGIC[4] = {'I', 'O', 'N', 'S'};
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+void writeSnapshotFile(const std::string &filename, const VmSnapshot &snapshot)
+{
+    std::ofstream out(filename, std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Could not write snapshot: " + filename);
+
+    uint32_t size = sizeof(VmSnapshot);
+    out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    out.write(reinterpret_cast<const char *>(&SNAPSHOT_VERSION), sizeof(SNAPSHOT_VERSION));
+    out.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    out.write(reinterpret_cast<const char *>(&snapshot), sizeof(snapshot));
+    if (!out)
+        throw std::runtime_error("Could not write snapshot: " + filename);
+}
+
+VmSnapshot readSnapshotFile(const std::string &filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Could not open snapshot: " + filename);
+
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t size = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char *>(&version), sizeof(version));
+    in.read(reinterpret_cast<char *>(&size), sizeof(size));
+    if (!in || std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+        throw std::runtime_error("Not an Ion snapshot: " + filename);
+    if (version != SNAPSHOT_VERSION || size != sizeof(VmSnapshot))
+        throw std::runtime_error("Unsupported snapshot version: " + filename);
+
+    VmSnapshot snapshot;
+    in.read(reinterpret_cast<char *>(&snapshot), sizeof(snapshot));
+    if (!in)
+        throw std::runtime_error("Truncated snapshot: " + filename);
+    return snapshot;
+}
@@ -0,0 +1,22 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "opcodes.h"
+#include <cstdint>
+#include <string>
+
+// Complete VM state at a point between instructions. Plain data, so taking
+// and restoring a snapshot is a straight copy.
+struct VmSnapshot {
+    uint64_t programHash; // ProgramImage::hash of the program it was taken from
+    int32_t registers[8];
+    int32_t memory[VM_MEMORY_SIZE];
+    int32_t pc; // index into the decoded program
+    int32_t running;
+};
+
+// On disk: "IONS", a format version, then the snapshot bytes in host order
+void writeSnapshotFile(const std::string& filename, const VmSnapshot& snapshot);
+VmSnapshot readSnapshotFile(const std::string& filename);
+
+#endif
@@ -0,0 +1,82 @@
+#include "strength.h"
+
+// k when value is 2^k, otherwise -1
+static int exactLog2(long long value)
+{
+    if (value <= 0 || (value & (value - 1)) != 0)
+        return -1;
+    int k = 0;
+    while ((1LL << k) != value)
+        ++k;
+    return k;
+}
+
+void StrengthReduction::run(IrFunction &function)
+{
+    this->function = &function;
+    for (IrBlock &block : function.blocks)
+    {
+        std::vector<IrInstr> instrs;
+        instrs.reserve(block.instrs.size());
+        out = &instrs;
+        for (IrInstr &instr : block.instrs)
+        {
+            bool reduced = false;
+            if ((instr.op == IrOp::Mul || instr.op == IrOp::Div) && !instr.args[0].immediate && instr.args[1].immediate)
+                reduced = instr.op == IrOp::Mul ? reduceMultiply(instr) : reduceDivide(instr);
+            if (!reduced)
+                instrs.push_back(std::move(instr));
+        }
+        block.instrs = std::move(instrs);
+    }
+    out = nullptr;
+    this->function = nullptr;
+}
+
+bool StrengthReduction::reduceMultiply(const IrInstr &instr)
+{
+    const IrOperand &x = instr.args[0];
+    long long factor = instr.args[1].value;
+
+    int k = exactLog2(factor);
+    if (k < 1)
+        return false;
+    emit(IrOp::Shl, {x, IrOperand::imm(k)}, instr.dst);
+    return true;
+}
+
+bool StrengthReduction::reduceDivide(const IrInstr &instr)
+{
+    const IrOperand &x = instr.args[0];
+    long long divisor = instr.args[1].value;
+
+    // Divisors of +-1 need no shift, and 2^31 has no positive counterpart
+    int k = exactLog2(divisor < 0 ? -divisor : divisor);
+    if (k < 1 || k > 30)
+        return false;
+
+    // bias = x < 0 ? 2^k - 1 : 0, taken from the top k bits of x's sign
+    IrOperand sign = k == 1 ? x : emit(IrOp::Sar, {x, IrOperand::imm(31)});
+    IrOperand bias = emit(IrOp::Shr, {sign, IrOperand::imm(32 - k)});
+    IrOperand biased = emit(IrOp::Add, {bias, x}); // sharing bias's register, as ProgramImage fuses it
+    if (divisor > 0)
+    {
+        emit(IrOp::Sar, {biased, IrOperand::imm(k)}, instr.dst);
+        return true;
+    }
+
+    IrOperand quotient = emit(IrOp::Sar, {biased, IrOperand::imm(k)});
+    IrOperand zero = emit(IrOp::Const, {IrOperand::imm(0)});
+    emit(IrOp::Sub, {zero, quotient}, instr.dst);
+    return true;
+}
+
+IrOperand StrengthReduction::emit(IrOp op, std::vector<IrOperand> args, int dst)
+{
+    IrInstr instr;
+    instr.op = op;
+    instr.dst = dst >= 0 ? dst : function->newValue(IrType::I32);
+    instr.args = std::move(args);
+    out->push_back(instr);
+    return IrOperand::reg(instr.dst);
+}
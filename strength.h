@@ -0,0 +1,30 @@
+#ifndef STRENGTH_H
+#define STRENGTH_H
+
+#include "ir.h"
+#include <vector>
+
+// Replaces multiplication and division by constants with shifts:
+//  - x * 2^k becomes x << k.
+//  - x / 2^k becomes an arithmetic shift of x biased by 2^k - 1 when x is
+//    negative, which rounds toward zero like DIV; x / -2^k negates that.
+//    ProgramImage fuses the sequence back into one record, so it costs the
+//    interpreter one dispatch and no idiv.
+// Other factors stay MULI: a shift/add pair costs one more dispatch than
+// the multiply it replaces. Wrapping makes every rewrite exact for all
+// 32-bit x, INT_MIN included.
+class StrengthReduction
+{
+public:
+    void run(IrFunction &function);
+
+private:
+    IrFunction *function = nullptr;
+    std::vector<IrInstr> *out = nullptr;
+
+    bool reduceMultiply(const IrInstr &instr);
+    bool reduceDivide(const IrInstr &instr);
+    IrOperand emit(IrOp op, std::vector<IrOperand> args, int dst = -1);
+};
+
+#endif
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Runs each tests/jit/*.sb with and without --jit at -O0 and -O1 and
+# fails if output, errors or exit status differ.
+# Usage: tests/jit_parity.sh path/to/ion
+ion=$(realpath "${1:?usage: $0 path/to/ion}")
+dir=$(cd "$(dirname "$0")/jit" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work" || exit 1
+
+status=0
+for source in "$dir"/*.sb; do
+    for level in -O0 -O1; do
+        "$ion" --no-cache $level "$source" > vm.out 2>&1
+        echo "exit $?" >> vm.out
+        "$ion" --no-cache $level --jit "$source" > jit.out 2>&1
+        echo "exit $?" >> jit.out
+        if ! cmp -s vm.out jit.out; then
+            echo "FAIL $(basename "$source") $level"
+            diff vm.out jit.out
+            status=1
+        fi
+    done
+done
+[ $status = 0 ] && echo "jit parity: ok"
+exit $status
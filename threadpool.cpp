@@ -0,0 +1,104 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = 1;
+
+    for (size_t i = 0; i < threadCount; ++i)
+        queues.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < threadCount; ++i)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    size_t index = nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    unfinished.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        queued.fetch_add(1);
+    }
+    workAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [this]
+                 { return unfinished.load() == 0; });
+}
+
+bool ThreadPool::popLocal(size_t index, std::function<void()> &task)
+{
+    Queue &queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+        return false;
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(size_t index, std::function<void()> &task)
+{
+    for (size_t offset = 1; offset < queues.size(); ++offset)
+    {
+        Queue &victim = *queues[(index + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty())
+            continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t index)
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        if (popLocal(index, task) || steal(index, task))
+        {
+            queued.fetch_sub(1);
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                // tasks report their own failures; keep the worker alive
+            }
+
+            if (unfinished.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                allDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(stateMutex);
+        workAvailable.wait(lock, [this]
+                           { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0)
+            return;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool with one task deque per worker. Workers take their own
+// newest task first and steal the oldest task from another worker when idle.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    // Blocks until every submitted task has finished
+    void wait();
+
+    size_t size() const { return workers.size(); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<size_t> queued{0};     // tasks sitting in a deque
+    std::atomic<size_t> unfinished{0}; // tasks submitted but not yet done
+
+    std::mutex stateMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+    bool stopping = false;
+
+    bool popLocal(size_t index, std::function<void()>& task);
+    bool steal(size_t index, std::function<void()>& task);
+    void workerLoop(size_t index);
+};
+
+#endif
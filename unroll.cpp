@@ -0,0 +1,452 @@
+#include "unroll.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+
+// Steps beyond this are left alone, so step * copies stays well inside 32 bits
+static const int MAX_STEP = 65535;
+
+static bool literalValue(const Expr *expr, int &value)
+{
+    if (expr->type != ExprType::LITERAL)
+        return false;
+
+    const std::string &text = static_cast<const LiteralExpr *>(expr)->value;
+    if (text == "true" || text == "false")
+        value = text == "true" ? 1 : 0;
+    else
+        value = static_cast<int>(static_cast<uint32_t>(std::stoll(text)));
+    return true;
+}
+
+static std::string mirrorComparison(const std::string &op)
+{
+    if (op == "<")
+        return ">";
+    if (op == ">")
+        return "<";
+    if (op == "<=")
+        return ">=";
+    if (op == ">=")
+        return "<=";
+    return op;
+}
+
+static bool isVariable(const Expr *expr, const std::string &name)
+{
+    return expr->type == ExprType::VARIABLE && static_cast<const VariableExpr *>(expr)->name == name;
+}
+
+static std::unique_ptr<Expr> cloneExpr(const Expr *expr)
+{
+    switch (expr->type)
+    {
+    case ExprType::LITERAL:
+        return std::make_unique<LiteralExpr>(static_cast<const LiteralExpr *>(expr)->value);
+    case ExprType::VARIABLE:
+        return std::make_unique<VariableExpr>(static_cast<const VariableExpr *>(expr)->name);
+    case ExprType::STRING_LITERAL:
+        return std::make_unique<StringLiteralExpr>(static_cast<const StringLiteralExpr *>(expr)->value);
+    default:
+    {
+        auto *bin = static_cast<const BinaryExpr *>(expr);
+        return std::make_unique<BinaryExpr>(cloneExpr(bin->left.get()), bin->op, cloneExpr(bin->right.get()));
+    }
+    }
+}
+
+static std::vector<std::unique_ptr<Stmt>> cloneBlock(const std::vector<std::unique_ptr<Stmt>> &block, size_t count);
+
+static std::unique_ptr<IfStmt> cloneIf(const IfStmt *ifStmt)
+{
+    return std::make_unique<IfStmt>(cloneExpr(ifStmt->condition.get()),
+                                    cloneBlock(ifStmt->thenBranch, ifStmt->thenBranch.size()),
+                                    cloneBlock(ifStmt->elseBranch, ifStmt->elseBranch.size()),
+                                    ifStmt->elseIfStmt ? cloneIf(ifStmt->elseIfStmt.get()) : nullptr);
+}
+
+static std::unique_ptr<Stmt> cloneStmt(const Stmt *stmt)
+{
+    switch (stmt->type)
+    {
+    case StmtType::VAR_DECL:
+    {
+        auto *decl = static_cast<const VarDeclStmt *>(stmt);
+        return std::make_unique<VarDeclStmt>(decl->varType, decl->varName, cloneExpr(decl->initializer.get()));
+    }
+    case StmtType::ASSIGN:
+    {
+        auto *assign = static_cast<const AssignStmt *>(stmt);
+        return std::make_unique<AssignStmt>(assign->varName, cloneExpr(assign->value.get()));
+    }
+    case StmtType::PRINT:
+        return std::make_unique<PrintStmt>(cloneExpr(static_cast<const PrintStmt *>(stmt)->expression.get()));
+    case StmtType::IF:
+        return cloneIf(static_cast<const IfStmt *>(stmt));
+    default:
+    {
+        auto *loop = static_cast<const WhileStmt *>(stmt);
+        return std::make_unique<WhileStmt>(cloneExpr(loop->condition.get()), cloneBlock(loop->body, loop->body.size()));
+    }
+    }
+}
+
+// The first count statements of block
+static std::vector<std::unique_ptr<Stmt>> cloneBlock(const std::vector<std::unique_ptr<Stmt>> &block, size_t count)
+{
+    std::vector<std::unique_ptr<Stmt>> copy;
+    copy.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        copy.push_back(cloneStmt(block[i].get()));
+    return copy;
+}
+
+static bool assigns(const std::vector<std::unique_ptr<Stmt>> &block, const std::string &name);
+
+static bool assigns(const Stmt *stmt, const std::string &name)
+{
+    switch (stmt->type)
+    {
+    case StmtType::VAR_DECL:
+        return static_cast<const VarDeclStmt *>(stmt)->varName == name;
+    case StmtType::ASSIGN:
+        return static_cast<const AssignStmt *>(stmt)->varName == name;
+    case StmtType::WHILE:
+        return assigns(static_cast<const WhileStmt *>(stmt)->body, name);
+    case StmtType::IF:
+    {
+        auto *ifStmt = static_cast<const IfStmt *>(stmt);
+        return assigns(ifStmt->thenBranch, name) || assigns(ifStmt->elseBranch, name) ||
+               (ifStmt->elseIfStmt && assigns(ifStmt->elseIfStmt.get(), name));
+    }
+    default:
+        return false;
+    }
+}
+
+static bool assigns(const std::vector<std::unique_ptr<Stmt>> &block, const std::string &name)
+{
+    for (const auto &stmt : block)
+    {
+        if (assigns(stmt.get(), name))
+            return true;
+    }
+    return false;
+}
+
+static bool reads(const Expr *expr, const std::string &name)
+{
+    if (expr->type == ExprType::VARIABLE)
+        return isVariable(expr, name);
+    if (expr->type != ExprType::BINARY)
+        return false;
+    auto *bin = static_cast<const BinaryExpr *>(expr);
+    return reads(bin->left.get(), name) || reads(bin->right.get(), name);
+}
+
+static bool reads(const std::vector<std::unique_ptr<Stmt>> &block, size_t count, const std::string &name);
+
+static bool reads(const Stmt *stmt, const std::string &name)
+{
+    switch (stmt->type)
+    {
+    case StmtType::VAR_DECL:
+        return reads(static_cast<const VarDeclStmt *>(stmt)->initializer.get(), name);
+    case StmtType::ASSIGN:
+        return reads(static_cast<const AssignStmt *>(stmt)->value.get(), name);
+    case StmtType::PRINT:
+        return reads(static_cast<const PrintStmt *>(stmt)->expression.get(), name);
+    case StmtType::WHILE:
+    {
+        auto *loop = static_cast<const WhileStmt *>(stmt);
+        return reads(loop->condition.get(), name) || reads(loop->body, loop->body.size(), name);
+    }
+    default:
+    {
+        auto *ifStmt = static_cast<const IfStmt *>(stmt);
+        return reads(ifStmt->condition.get(), name) || reads(ifStmt->thenBranch, ifStmt->thenBranch.size(), name) ||
+               reads(ifStmt->elseBranch, ifStmt->elseBranch.size(), name) ||
+               (ifStmt->elseIfStmt && reads(ifStmt->elseIfStmt.get(), name));
+    }
+    }
+}
+
+// Whether the first count statements of block read name
+static bool reads(const std::vector<std::unique_ptr<Stmt>> &block, size_t count, const std::string &name)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (reads(block[i].get(), name))
+            return true;
+    }
+    return false;
+}
+
+static int statementCount(const std::vector<std::unique_ptr<Stmt>> &block);
+
+static int statementCount(const Stmt *stmt)
+{
+    if (stmt->type == StmtType::WHILE)
+        return 1 + statementCount(static_cast<const WhileStmt *>(stmt)->body);
+    if (stmt->type != StmtType::IF)
+        return 1;
+    auto *ifStmt = static_cast<const IfStmt *>(stmt);
+    return 1 + statementCount(ifStmt->thenBranch) + statementCount(ifStmt->elseBranch) +
+           (ifStmt->elseIfStmt ? statementCount(ifStmt->elseIfStmt.get()) : 0);
+}
+
+static int statementCount(const std::vector<std::unique_ptr<Stmt>> &block)
+{
+    int count = 0;
+    for (const auto &stmt : block)
+        count += statementCount(stmt.get());
+    return count;
+}
+
+static std::unique_ptr<Stmt> makeStep(const std::string &var, int64_t amount)
+{
+    return std::make_unique<AssignStmt>(
+        var, std::make_unique<BinaryExpr>(std::make_unique<VariableExpr>(var), amount < 0 ? "-" : "+",
+                                          std::make_unique<LiteralExpr>(std::to_string(std::llabs(amount)))));
+}
+
+// Appends copies of the loop body. When the body reads the induction
+// variable only in its final step, the copies share one combined step.
+static void appendCopies(std::vector<std::unique_ptr<Stmt>> &out, const std::vector<std::unique_ptr<Stmt>> &body,
+                         const std::string &var, int step, int copies)
+{
+    size_t work = body.size() - 1;
+    bool mergeSteps = !reads(body, work, var);
+    for (int copy = 0; copy < copies; ++copy)
+    {
+        for (auto &stmt : cloneBlock(body, mergeSteps ? work : body.size()))
+            out.push_back(std::move(stmt));
+    }
+    if (mergeSteps && copies > 0)
+        out.push_back(makeStep(var, static_cast<int64_t>(step) * copies));
+}
+
+LoopUnroller::LoopUnroller(int factor) : factor(factor) {}
+
+bool LoopUnroller::run(std::vector<std::unique_ptr<Stmt>> &program)
+{
+    changed = false;
+    if (factor > 1)
+        unrollBlock(program);
+    return changed;
+}
+
+void LoopUnroller::unrollBlock(std::vector<std::unique_ptr<Stmt>> &block)
+{
+    for (size_t i = 0; i < block.size(); ++i)
+    {
+        Stmt *stmt = block[i].get();
+        if (stmt->type == StmtType::IF)
+        {
+            for (auto *ifStmt = static_cast<IfStmt *>(stmt); ifStmt; ifStmt = ifStmt->elseIfStmt.get())
+            {
+                unrollBlock(ifStmt->thenBranch);
+                unrollBlock(ifStmt->elseBranch);
+            }
+        }
+        else if (stmt->type == StmtType::WHILE)
+        {
+            unrollBlock(static_cast<WhileStmt *>(stmt)->body);
+
+            // Leaves i on the last statement the expansion put in place
+            CountedLoop loop;
+            size_t before = block.size();
+            if (analyze(block, i, loop) && expand(block, i, loop))
+            {
+                i += block.size() - before;
+                changed = true;
+            }
+        }
+    }
+}
+
+bool LoopUnroller::analyze(const std::vector<std::unique_ptr<Stmt>> &block, size_t index, CountedLoop &loop) const
+{
+    auto *whileStmt = static_cast<const WhileStmt *>(block[index].get());
+    const std::vector<std::unique_ptr<Stmt>> &body = whileStmt->body;
+    if (body.empty() || body.back()->type != StmtType::ASSIGN)
+        return false;
+
+    // The step: i = i + c, i = c + i or i = i - c
+    auto *last = static_cast<const AssignStmt *>(body.back().get());
+    loop.var = last->varName;
+    if (last->value->type != ExprType::BINARY)
+        return false;
+    auto *update = static_cast<const BinaryExpr *>(last->value.get());
+    int amount = 0;
+    if (update->op == "+" && isVariable(update->left.get(), loop.var) && literalValue(update->right.get(), amount))
+        loop.step = amount;
+    else if (update->op == "+" && isVariable(update->right.get(), loop.var) && literalValue(update->left.get(), amount))
+        loop.step = amount;
+    else if (update->op == "-" && isVariable(update->left.get(), loop.var) && literalValue(update->right.get(), amount))
+        loop.step = -amount;
+    else
+        return false;
+    if (loop.step == 0 || amount < -MAX_STEP || amount > MAX_STEP)
+        return false;
+
+    // The test: i against the bound, in the direction i moves
+    if (whileStmt->condition->type != ExprType::BINARY)
+        return false;
+    auto *condition = static_cast<const BinaryExpr *>(whileStmt->condition.get());
+    if (isVariable(condition->left.get(), loop.var))
+    {
+        loop.compare = condition->op;
+        loop.bound = condition->right.get();
+    }
+    else if (isVariable(condition->right.get(), loop.var))
+    {
+        loop.compare = mirrorComparison(condition->op);
+        loop.bound = condition->left.get();
+    }
+    else
+        return false;
+
+    bool ascending = loop.compare == "<" || loop.compare == "<=";
+    bool descending = loop.compare == ">" || loop.compare == ">=";
+    if (!(ascending && loop.step > 0) && !(descending && loop.step < 0))
+        return false;
+
+    int boundValue = 0;
+    if (!literalValue(loop.bound, boundValue))
+    {
+        if (loop.bound->type != ExprType::VARIABLE || isVariable(loop.bound, loop.var) ||
+            assigns(body, static_cast<const VariableExpr *>(loop.bound)->name))
+            return false;
+    }
+
+    for (size_t i = 0; i + 1 < body.size(); ++i)
+    {
+        if (assigns(body[i].get(), loop.var))
+            return false;
+    }
+
+    // The start, from the last assignment in straight-line code before the loop
+    for (size_t i = index; i-- > 0;)
+    {
+        const Stmt *stmt = block[i].get();
+        if (!assigns(stmt, loop.var))
+            continue;
+        const Expr *value = nullptr;
+        if (stmt->type == StmtType::VAR_DECL)
+            value = static_cast<const VarDeclStmt *>(stmt)->initializer.get();
+        else if (stmt->type == StmtType::ASSIGN)
+            value = static_cast<const AssignStmt *>(stmt)->value.get();
+        loop.startKnown = value && literalValue(value, loop.start);
+        break;
+    }
+    return true;
+}
+
+bool LoopUnroller::expand(std::vector<std::unique_ptr<Stmt>> &block, size_t index, const CountedLoop &loop)
+{
+    auto *whileStmt = static_cast<WhileStmt *>(block[index].get());
+    const std::vector<std::unique_ptr<Stmt>> &body = whileStmt->body;
+    int size = statementCount(body);
+    int boundValue = 0;
+    bool literalBound = literalValue(loop.bound, boundValue);
+
+    auto fits = [&](int64_t copies) { return copies * size <= MAX_UNROLLED_STATEMENTS; };
+
+    std::vector<std::unique_ptr<Stmt>> expansion;
+    if (loop.startKnown && literalBound)
+    {
+        int64_t start = loop.start;
+        int64_t bound = boundValue;
+        int64_t step = loop.step;
+        int64_t trips = 0;
+        if (loop.compare == "<" && start < bound)
+            trips = (bound - start + step - 1) / step;
+        else if (loop.compare == "<=" && start <= bound)
+            trips = (bound - start) / step + 1;
+        else if (loop.compare == ">" && start > bound)
+            trips = (start - bound - step - 1) / -step;
+        else if (loop.compare == ">=" && start >= bound)
+            trips = (start - bound) / -step + 1;
+
+        // A final value that wraps would keep the original loop going
+        int64_t end = start + trips * step;
+        if (trips == 0 || end < INT_MIN || end > INT_MAX)
+            return false;
+
+        if (trips <= FULL_UNROLL_TRIPS && fits(trips))
+        {
+            appendCopies(expansion, body, loop.var, loop.step, static_cast<int>(trips));
+        }
+        else
+        {
+            int copies = std::min(factor, MAX_UNROLLED_STATEMENTS);
+            while (copies > 1 && !fits(copies + (trips % copies)))
+                --copies;
+            if (copies < 2 || trips < copies)
+                return false;
+
+            // Runs while a whole group of iterations remains, which the
+            // start and bound bound away from wrapping
+            int64_t limit = bound - (copies - 1) * step;
+            std::vector<std::unique_ptr<Stmt>> unrolled;
+            appendCopies(unrolled, body, loop.var, loop.step, copies);
+            expansion.push_back(std::make_unique<WhileStmt>(
+                std::make_unique<BinaryExpr>(std::make_unique<VariableExpr>(loop.var), loop.compare,
+                                             std::make_unique<LiteralExpr>(std::to_string(limit))),
+                std::move(unrolled)));
+            appendCopies(expansion, body, loop.var, loop.step, static_cast<int>(trips % copies));
+        }
+    }
+    else
+    {
+        // The original loop stays as the epilogue, and a variable bound
+        // needs a guard against the shortened bound wrapping
+        int copies = std::min(factor, MAX_UNROLLED_STATEMENTS);
+        while (copies > 1 && !fits(copies + 1))
+            --copies;
+        if (copies < 2)
+            return false;
+
+        int64_t shortfall = static_cast<int64_t>(copies - 1) * loop.step;
+        std::unique_ptr<Expr> limit;
+        std::unique_ptr<Expr> guard;
+        if (literalBound)
+        {
+            int64_t value = boundValue - shortfall;
+            if (value < INT_MIN || value > INT_MAX)
+                return false;
+            limit = std::make_unique<LiteralExpr>(std::to_string(value));
+        }
+        else
+        {
+            const std::string &name = static_cast<const VariableExpr *>(loop.bound)->name;
+            limit = std::make_unique<BinaryExpr>(std::make_unique<VariableExpr>(name), "-",
+                                                 std::make_unique<LiteralExpr>(std::to_string(shortfall)));
+            int64_t edge = loop.step > 0 ? INT_MIN + shortfall : INT_MAX + shortfall;
+            guard = std::make_unique<BinaryExpr>(std::make_unique<VariableExpr>(name), loop.step > 0 ? ">=" : "<=",
+                                                 std::make_unique<LiteralExpr>(std::to_string(edge)));
+        }
+
+        std::vector<std::unique_ptr<Stmt>> unrolled;
+        appendCopies(unrolled, body, loop.var, loop.step, copies);
+        auto unrolledLoop = std::make_unique<WhileStmt>(
+            std::make_unique<BinaryExpr>(std::make_unique<VariableExpr>(loop.var), loop.compare, std::move(limit)),
+            std::move(unrolled));
+        if (guard)
+        {
+            std::vector<std::unique_ptr<Stmt>> guarded;
+            guarded.push_back(std::move(unrolledLoop));
+            expansion.push_back(std::make_unique<IfStmt>(std::move(guard), std::move(guarded)));
+        }
+        else
+            expansion.push_back(std::move(unrolledLoop));
+        expansion.push_back(std::move(block[index]));
+    }
+
+    block.erase(block.begin() + index);
+    block.insert(block.begin() + index, std::make_move_iterator(expansion.begin()),
+                 std::make_move_iterator(expansion.end()));
+    return true;
+}
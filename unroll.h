@@ -0,0 +1,51 @@
+#ifndef UNROLL_H
+#define UNROLL_H
+
+#include "ast.h"
+#include <string>
+#include <vector>
+
+// Unrolls counted while loops: the body ends with i = i + c or i = i - c,
+// nothing else in it assigns i, and the condition compares i against a
+// literal or a variable the body never assigns, in the direction i moves.
+//  - With a known start and literal bound, a loop of at most
+//    FULL_UNROLL_TRIPS iterations becomes straight-line code, and a longer
+//    one runs `factor` bodies per test with the leftover bodies after it.
+//  - Otherwise the unrolled loop stops `factor` - 1 steps short of the
+//    bound and the original loop finishes as the epilogue. A variable bound
+//    close enough to INT_MIN / INT_MAX to wrap skips the unrolled loop.
+// Inner loops go first. A loop is unrolled less, or not at all, when its
+// copies would exceed MAX_UNROLLED_STATEMENTS. Run ConstantFolder again
+// afterwards to fold the copies.
+class LoopUnroller
+{
+public:
+    static constexpr int DEFAULT_FACTOR = 4;
+    static constexpr int FULL_UNROLL_TRIPS = 16;
+    static constexpr int MAX_UNROLLED_STATEMENTS = 64;
+
+    explicit LoopUnroller(int factor = DEFAULT_FACTOR);
+
+    // Returns whether any loop was unrolled
+    bool run(std::vector<std::unique_ptr<Stmt>> &program);
+
+private:
+    struct CountedLoop
+    {
+        std::string var;
+        int step = 0;        // signed increment per iteration
+        std::string compare; // i <compare> bound, after mirroring
+        const Expr *bound = nullptr;
+        bool startKnown = false;
+        int start = 0;
+    };
+
+    int factor;
+    bool changed = false;
+
+    void unrollBlock(std::vector<std::unique_ptr<Stmt>> &block);
+    bool analyze(const std::vector<std::unique_ptr<Stmt>> &block, size_t index, CountedLoop &loop) const;
+    bool expand(std::vector<std::unique_ptr<Stmt>> &block, size_t index, const CountedLoop &loop);
+};
+
+#endif
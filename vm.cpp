@@ -1,8 +1,11 @@
 #include "vm.h"
-#include <iostream>
-#include <sstream>
+#include "jit.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
 
 VirtualMachine::VirtualMachine()
+    : defaultOutput(std::make_unique<FdOutputSink>(1)), output(defaultOutput.get())
 {
     for (int &reg : registers)
         reg = 0;
@@ -12,252 +15,575 @@ VirtualMachine::VirtualMachine()
     running = true;
 }
 
-void VirtualMachine::loadProgram(const std::vector<std::string> &program)
+void VirtualMachine::setOutput(OutputSink *sink)
 {
-    instructions.clear();
-    stringData.clear();
+    output = sink ? sink : defaultOutput.get();
+}
 
-    for (const std::string &line : program)
-    {
-        std::istringstream iss(line);
-        std::string keyword;
-        iss >> keyword;
+void VirtualMachine::load(std::shared_ptr<const ProgramImage> image)
+{
+    if (!image)
+        throw std::runtime_error("No program image to load");
+    program = std::move(image);
+    pc = 0;
+    running = true;
+    retired = 0;
+    fault.clear();
+}
 
-        if (keyword == "DATA")
-        {
-            std::string label;
-            iss >> label;
+void VirtualMachine::loadProgram(const InstructionBuffer &program)
+{
+    load(ProgramImage::fromInstructions(program, fusion));
+}
 
-            std::string rest;
-            std::getline(iss, rest); // get the remainder of the line
-            size_t firstQuote = rest.find('"');
-            size_t lastQuote = rest.rfind('"');
+void VirtualMachine::loadProgram(const std::vector<std::string> &assembly)
+{
+    load(ProgramImage::fromAssembly(assembly, fusion));
+}
 
-            if (firstQuote == std::string::npos || lastQuote == std::string::npos || lastQuote <= firstQuote)
-            {
-                throw std::runtime_error("Invalid DATA string format: " + line);
-            }
+void VirtualMachine::loadBinary(const std::string &filename)
+{
+    load(ProgramImage::fromBinaryFile(filename, fusion));
+}
 
-            std::string value = rest.substr(firstQuote + 1, lastQuote - firstQuote - 1);
-            stringData[label] = value;
-        }
-        else
-        {
-            instructions.push_back(line); // only actual instructions go here
-        }
-    }
+void VirtualMachine::loadBinary(const std::vector<uint8_t> &bytes)
+{
+    load(ProgramImage::fromBinary(bytes, fusion));
+}
 
-    parseLabels(); // must come after filtering lines
+void VirtualMachine::setFusion(bool enabled)
+{
+    fusion = enabled;
 }
 
-void VirtualMachine::parseLabels()
+int VirtualMachine::instructionCount() const
 {
-    for (int i = 0; i < instructions.size(); ++i)
-    {
-        std::string line = instructions[i];
-        std::istringstream iss(line);
-        std::string word;
-        iss >> word;
-        if (word == "LABEL")
-        {
-            std::string label;
-            iss >> label;
-            labelMap[label] = i;
-        }
-    }
+    return program ? program->instructionCount() : 0;
 }
 
-int VirtualMachine::getRegisterIndex(const std::string &reg)
+VmSnapshot VirtualMachine::snapshot() const
 {
-    if (reg.length() == 2 && reg[0] == 'R')
-    {
-        return reg[1] - '0';
-    }
-    throw std::runtime_error("Invalid register: " + reg);
+    if (!program)
+        throw std::runtime_error("No program loaded to snapshot");
+
+    VmSnapshot state;
+    state.programHash = program->hash;
+    std::memcpy(state.registers, registers, sizeof(state.registers));
+    std::memcpy(state.memory, memory, sizeof(state.memory));
+    state.pc = pc;
+    state.running = running;
+    return state;
 }
 
-void VirtualMachine::run()
+void VirtualMachine::restore(const VmSnapshot &state)
 {
-    while (running && pc < instructions.size())
-    {
-        std::string line = instructions[pc];
-        executeInstruction(line);
-        ++pc;
-    }
+    if (!program)
+        throw std::runtime_error("No program loaded to restore into");
+    if (state.programHash != program->hash)
+        throw std::runtime_error("Snapshot was taken from a different program");
+    if (state.pc < 0 || state.pc >= static_cast<int>(program->code.size()))
+        throw std::runtime_error("Snapshot pc out of range: " + std::to_string(state.pc));
+
+    std::memcpy(registers, state.registers, sizeof(registers));
+    std::memcpy(memory, state.memory, sizeof(memory));
+    pc = state.pc;
+    running = state.running != 0;
 }
 
-std::string cleanToken(std::string token)
+void VirtualMachine::saveSnapshot(const std::string &filename) const
 {
-    if (!token.empty() && token.back() == ',')
-        token.pop_back();
-    return token;
+    writeSnapshotFile(filename, snapshot());
 }
 
-void VirtualMachine::executeInstruction(const std::string &line)
+void VirtualMachine::loadSnapshot(const std::string &filename)
 {
-    std::istringstream iss(line);
-    std::string op;
-    iss >> op;
+    restore(readSnapshotFile(filename));
+}
 
-    if (op == "LOAD")
-    {
-        std::string reg;
-        int value;
-        iss >> reg >> value;
-        reg = cleanToken(reg);
-        registers[getRegisterIndex(reg)] = value;
-    }
-    else if (op == "MOV")
-    {
-        std::string dst, src;
-        iss >> dst >> src;
-        dst = cleanToken(dst);
-        src = cleanToken(src);
-        registers[getRegisterIndex(dst)] = registers[getRegisterIndex(src)];
+#if defined(__GNUC__) || defined(__clang__)
+#define ION_COMPUTED_GOTO 1
+#define ION_UNUSED_LABEL __attribute__((unused));
+#else
+#define ION_UNUSED_LABEL ;
+#endif
+
+// Each handler is both a switch case and, with computed goto, a jump target
+// in the dispatch table, so the two loops share one body.
+#ifdef ION_COMPUTED_GOTO
+#define HANDLER(name) \
+    case Opcode::name: \
+    op_##name:         \
+    ION_UNUSED_LABEL
+#define DISPATCH()                                         \
+    do                                                     \
+    {                                                      \
+        CHARGE_BUDGET();                                   \
+        PROFILE_HIT();                                     \
+        if constexpr (Threaded)                            \
+            goto *table[static_cast<uint8_t>(ip->opcode)]; \
+        else                                               \
+            goto dispatch;                                 \
+    } while (0)
+#else
+#define HANDLER(name) case Opcode::name:
+#define DISPATCH()       \
+    do                   \
+    {                    \
+        CHARGE_BUDGET(); \
+        PROFILE_HIT();   \
+        goto dispatch;   \
+    } while (0)
+#endif
+
+// Only the Budgeted instantiation counts instructions. A fused record is
+// charged its full width, so a slice may overrun by at most one record.
+#define CHARGE_BUDGET()            \
+    if constexpr (Budgeted)        \
+    {                              \
+        if (remaining <= 0)        \
+            goto yield;            \
+        remaining -= ip->width;    \
     }
-    else if (op == "ADD")
-    {
-        std::string dst, src;
-        iss >> dst >> src;
-        dst = cleanToken(dst);
-        src = cleanToken(src);
-        registers[getRegisterIndex(dst)] += registers[getRegisterIndex(src)];
+
+// Counters only exist in the Profile instantiation of execute()
+#define PROFILE_HIT()          \
+    if constexpr (Profile)     \
+    {                          \
+        ++hits[ip - base];     \
     }
-    else if (op == "SUB")
-    {
-        std::string dst, src;
-        iss >> dst >> src;
-        dst = cleanToken(dst);
-        src = cleanToken(src);
-        registers[getRegisterIndex(dst)] -= registers[getRegisterIndex(src)];
+#define PROFILE_TAKEN()        \
+    if constexpr (Profile)     \
+    {                          \
+        ++taken[ip - base];    \
     }
-    else if (op == "MUL")
+
+#define NEXT() \
+    do         \
+    {          \
+        ++ip;  \
+        DISPATCH(); \
+    } while (0)
+
+#define JUMP_IF(cond)                 \
+    do                                \
+    {                                 \
+        if (cond)                     \
+        {                             \
+            PROFILE_TAKEN();          \
+            ip = base + ip->target;   \
+        }                             \
+        else                          \
+        {                             \
+            ++ip;                     \
+        }                             \
+        DISPATCH();                   \
+    } while (0)
+
+// Division traps instead of raising SIGFPE; INT_MIN / -1 wraps
+#define DIVIDE(dst, lhs, rhs)                                                        \
+    do                                                                               \
+    {                                                                                \
+        int divisor = (rhs);                                                         \
+        if (divisor == 0)                                                            \
+            goto div_zero;                                                           \
+        int dividend = (lhs);                                                        \
+        dst = divisor == -1 ? static_cast<int>(0u - static_cast<unsigned>(dividend)) \
+                            : dividend / divisor;                                    \
+    } while (0)
+
+// Shift counts use their low five bits, as on x86, so no count is undefined
+#define SHIFT_LEFT(value, count) static_cast<int>(static_cast<unsigned>(value) << ((count) & 31))
+#define SHIFT_RIGHT(value, count) static_cast<int>(static_cast<unsigned>(value) >> ((count) & 31))
+#define SHIFT_ARITHMETIC(value, count) ((value) >> ((count) & 31))
+
+// Fused CMP a, b + conditional LOAD: R0 still receives the comparison result
+#define SET_COMPARE(op, rhsValue)          \
+    do                                     \
+    {                                      \
+        int lhs = r[ip->src];              \
+        int rhs = (rhsValue);              \
+        r[0] = (lhs > rhs) - (lhs < rhs);  \
+        r[ip->dst] = lhs op rhs;           \
+        NEXT();                            \
+    } while (0)
+#define SET_IF(op) SET_COMPARE(op, r[ip->target])
+#define SET_IF_IMM(op) SET_COMPARE(op, ip->target)
+
+template <bool Threaded, bool Profile, bool Budgeted>
+StepStatus VirtualMachine::execute(uint64_t budget)
+{
+    if (!program)
+        throw std::runtime_error("No program loaded");
+    if (!running || program->code[pc].opcode == Opcode::END)
+        return StepStatus::Halted;
+
+    // Registers and pc live in locals for the whole loop
+    int r[8];
+    std::copy(registers, registers + 8, r);
+    const std::vector<std::string> &strings = program->strings;
+    const DecodedInstruction *base = program->code.data();
+    const DecodedInstruction *ip = base + pc;
+    int64_t remaining = static_cast<int64_t>(budget);
+    StepStatus status = StepStatus::Halted;
+
+    uint64_t *hits = nullptr;
+    uint64_t *taken = nullptr;
+    if constexpr (Profile)
     {
-        std::string dst, src;
-        iss >> dst >> src;
-        dst = cleanToken(dst);
-        src = cleanToken(src);
-        registers[getRegisterIndex(dst)] *= registers[getRegisterIndex(src)];
+        profiler->prepare(program->code.size());
+        hits = profiler->hitCounts();
+        taken = profiler->takenCounts();
     }
-    else if (op == "DIV")
+
+#ifdef ION_COMPUTED_GOTO
+    void *table[256];
+    if constexpr (Threaded)
     {
-        std::string dst, src;
-        iss >> dst >> src;
-        dst = cleanToken(dst);
-        src = cleanToken(src);
-        registers[getRegisterIndex(dst)] /= registers[getRegisterIndex(src)];
+        for (void *&entry : table)
+            entry = &&op_invalid;
+        table[static_cast<uint8_t>(Opcode::LOAD)] = &&op_LOAD;
+        table[static_cast<uint8_t>(Opcode::MOV)] = &&op_MOV;
+        table[static_cast<uint8_t>(Opcode::ADD)] = &&op_ADD;
+        table[static_cast<uint8_t>(Opcode::SUB)] = &&op_SUB;
+        table[static_cast<uint8_t>(Opcode::MUL)] = &&op_MUL;
+        table[static_cast<uint8_t>(Opcode::DIV)] = &&op_DIV;
+        table[static_cast<uint8_t>(Opcode::CMP)] = &&op_CMP;
+        table[static_cast<uint8_t>(Opcode::CMPI)] = &&op_CMPI;
+        table[static_cast<uint8_t>(Opcode::ADDI)] = &&op_ADDI;
+        table[static_cast<uint8_t>(Opcode::SUBI)] = &&op_SUBI;
+        table[static_cast<uint8_t>(Opcode::MULI)] = &&op_MULI;
+        table[static_cast<uint8_t>(Opcode::DIVI)] = &&op_DIVI;
+        table[static_cast<uint8_t>(Opcode::SHL)] = &&op_SHL;
+        table[static_cast<uint8_t>(Opcode::SHR)] = &&op_SHR;
+        table[static_cast<uint8_t>(Opcode::SAR)] = &&op_SAR;
+        table[static_cast<uint8_t>(Opcode::AND)] = &&op_AND;
+        table[static_cast<uint8_t>(Opcode::SHLI)] = &&op_SHLI;
+        table[static_cast<uint8_t>(Opcode::SHRI)] = &&op_SHRI;
+        table[static_cast<uint8_t>(Opcode::SARI)] = &&op_SARI;
+        table[static_cast<uint8_t>(Opcode::ANDI)] = &&op_ANDI;
+        table[static_cast<uint8_t>(Opcode::JMP)] = &&op_JMP;
+        table[static_cast<uint8_t>(Opcode::JE)] = &&op_JE;
+        table[static_cast<uint8_t>(Opcode::JNE)] = &&op_JNE;
+        table[static_cast<uint8_t>(Opcode::JLT)] = &&op_JLT;
+        table[static_cast<uint8_t>(Opcode::JGT)] = &&op_JGT;
+        table[static_cast<uint8_t>(Opcode::JLE)] = &&op_JLE;
+        table[static_cast<uint8_t>(Opcode::JGE)] = &&op_JGE;
+        table[static_cast<uint8_t>(Opcode::PRINT)] = &&op_PRINT;
+        table[static_cast<uint8_t>(Opcode::PRINTS)] = &&op_PRINTS;
+        table[static_cast<uint8_t>(Opcode::HALT)] = &&op_HALT;
+        table[static_cast<uint8_t>(Opcode::LDM)] = &&op_LDM;
+        table[static_cast<uint8_t>(Opcode::STM)] = &&op_STM;
+        table[static_cast<uint8_t>(Opcode::END)] = &&op_END;
+        table[static_cast<uint8_t>(Opcode::ADD3)] = &&op_ADD3;
+        table[static_cast<uint8_t>(Opcode::SUB3)] = &&op_SUB3;
+        table[static_cast<uint8_t>(Opcode::MUL3)] = &&op_MUL3;
+        table[static_cast<uint8_t>(Opcode::DIV3)] = &&op_DIV3;
+        table[static_cast<uint8_t>(Opcode::CMPZ_JE)] = &&op_CMPZ_JE;
+        table[static_cast<uint8_t>(Opcode::SETE)] = &&op_SETE;
+        table[static_cast<uint8_t>(Opcode::SETNE)] = &&op_SETNE;
+        table[static_cast<uint8_t>(Opcode::SETLT)] = &&op_SETLT;
+        table[static_cast<uint8_t>(Opcode::SETGT)] = &&op_SETGT;
+        table[static_cast<uint8_t>(Opcode::SETLE)] = &&op_SETLE;
+        table[static_cast<uint8_t>(Opcode::SETGE)] = &&op_SETGE;
+        table[static_cast<uint8_t>(Opcode::SETEI)] = &&op_SETEI;
+        table[static_cast<uint8_t>(Opcode::SETNEI)] = &&op_SETNEI;
+        table[static_cast<uint8_t>(Opcode::SETLTI)] = &&op_SETLTI;
+        table[static_cast<uint8_t>(Opcode::SETGTI)] = &&op_SETGTI;
+        table[static_cast<uint8_t>(Opcode::SETLEI)] = &&op_SETLEI;
+        table[static_cast<uint8_t>(Opcode::SETGEI)] = &&op_SETGEI;
+        table[static_cast<uint8_t>(Opcode::DIVP2)] = &&op_DIVP2;
     }
-    else if (op == "CMP")
-    {
-        std::string lhs, rhs;
-        iss >> lhs >> rhs;
-        lhs = cleanToken(lhs);
-        rhs = cleanToken(rhs);
+#endif
 
-        int r1 = registers[getRegisterIndex(lhs)];
-        int r2;
+    DISPATCH();
 
-        // Check if rhs is a register or a literal
-        if (rhs[0] == 'R')
+dispatch:
+    ION_UNUSED_LABEL
+    switch (ip->opcode)
+    {
+        HANDLER(LOAD)
+        r[ip->dst] = ip->src;
+        NEXT();
+        HANDLER(MOV)
+        r[ip->dst] = r[ip->src];
+        NEXT();
+        HANDLER(ADD)
+        r[ip->dst] += r[ip->src];
+        NEXT();
+        HANDLER(SUB)
+        r[ip->dst] -= r[ip->src];
+        NEXT();
+        HANDLER(MUL)
+        r[ip->dst] *= r[ip->src];
+        NEXT();
+        HANDLER(DIV)
+        DIVIDE(r[ip->dst], r[ip->dst], r[ip->src]);
+        NEXT();
+        HANDLER(CMP)
+        r[0] = (r[ip->dst] > r[ip->src]) - (r[ip->dst] < r[ip->src]);
+        NEXT();
+        HANDLER(CMPI)
+        r[0] = (r[ip->dst] > ip->src) - (r[ip->dst] < ip->src);
+        NEXT();
+        HANDLER(ADDI)
+        r[ip->dst] += ip->src;
+        NEXT();
+        HANDLER(SUBI)
+        r[ip->dst] -= ip->src;
+        NEXT();
+        HANDLER(MULI)
+        r[ip->dst] *= ip->src;
+        NEXT();
+        HANDLER(DIVI)
+        DIVIDE(r[ip->dst], r[ip->dst], ip->src);
+        NEXT();
+        HANDLER(SHL)
+        r[ip->dst] = SHIFT_LEFT(r[ip->dst], r[ip->src]);
+        NEXT();
+        HANDLER(SHR)
+        r[ip->dst] = SHIFT_RIGHT(r[ip->dst], r[ip->src]);
+        NEXT();
+        HANDLER(SAR)
+        r[ip->dst] = SHIFT_ARITHMETIC(r[ip->dst], r[ip->src]);
+        NEXT();
+        HANDLER(AND)
+        r[ip->dst] &= r[ip->src];
+        NEXT();
+        HANDLER(SHLI)
+        r[ip->dst] = SHIFT_LEFT(r[ip->dst], ip->src);
+        NEXT();
+        HANDLER(SHRI)
+        r[ip->dst] = SHIFT_RIGHT(r[ip->dst], ip->src);
+        NEXT();
+        HANDLER(SARI)
+        r[ip->dst] = SHIFT_ARITHMETIC(r[ip->dst], ip->src);
+        NEXT();
+        HANDLER(ANDI)
+        r[ip->dst] &= ip->src;
+        NEXT();
+        HANDLER(JMP)
+        PROFILE_TAKEN();
+        ip = base + ip->target;
+        DISPATCH();
+        HANDLER(JE)
+        JUMP_IF(r[0] == 0);
+        HANDLER(JNE)
+        JUMP_IF(r[0] != 0);
+        HANDLER(JLT)
+        JUMP_IF(r[0] < 0);
+        HANDLER(JGT)
+        JUMP_IF(r[0] > 0);
+        HANDLER(JLE)
+        JUMP_IF(r[0] <= 0);
+        HANDLER(JGE)
+        JUMP_IF(r[0] >= 0);
+        HANDLER(PRINT)
+        output->writeInt(r[ip->dst]);
+        NEXT();
+        HANDLER(PRINTS)
+        output->writeLine(strings[ip->target]);
+        NEXT();
+        HANDLER(LDM)
+        r[ip->dst] = memory[ip->src];
+        NEXT();
+        HANDLER(STM)
+        memory[ip->src] = r[ip->dst];
+        NEXT();
+        HANDLER(HALT)
+        running = false;
+        ++ip;
+        goto done;
+        HANDLER(END)
+        goto done;
+        HANDLER(ADD3)
+        r[ip->dst] = r[ip->src] + r[ip->target];
+        NEXT();
+        HANDLER(SUB3)
+        r[ip->dst] = r[ip->src] - r[ip->target];
+        NEXT();
+        HANDLER(MUL3)
+        r[ip->dst] = r[ip->src] * r[ip->target];
+        NEXT();
+        HANDLER(DIV3)
+        DIVIDE(r[ip->dst], r[ip->src], r[ip->target]);
+        NEXT();
+        HANDLER(CMPZ_JE)
         {
-            r2 = registers[getRegisterIndex(rhs)];
+            int value = r[ip->dst];
+            r[0] = (value > 0) - (value < 0);
+            JUMP_IF(value == 0);
         }
-        else
+        HANDLER(SETE)
+        SET_IF(==);
+        HANDLER(SETNE)
+        SET_IF(!=);
+        HANDLER(SETLT)
+        SET_IF(<);
+        HANDLER(SETGT)
+        SET_IF(>);
+        HANDLER(SETLE)
+        SET_IF(<=);
+        HANDLER(SETGE)
+        SET_IF(>=);
+        HANDLER(SETEI)
+        SET_IF_IMM(==);
+        HANDLER(SETNEI)
+        SET_IF_IMM(!=);
+        HANDLER(SETLTI)
+        SET_IF_IMM(<);
+        HANDLER(SETGTI)
+        SET_IF_IMM(>);
+        HANDLER(SETLEI)
+        SET_IF_IMM(<=);
+        HANDLER(SETGEI)
+        SET_IF_IMM(>=);
+        HANDLER(DIVP2)
         {
-            r2 = std::stoi(rhs);
+            int value = r[ip->src];
+            int bias = SHIFT_RIGHT(SHIFT_ARITHMETIC(value, 31), 32 - ip->target);
+            r[ip->dst] = SHIFT_ARITHMETIC(value + bias, ip->target);
+            NEXT();
         }
-
-        if (r1 == r2)
-            registers[0] = 0;
-        else if (r1 < r2)
-            registers[0] = -1;
-        else
-            registers[0] = 1;
+    default:
+        goto op_invalid;
     }
-    else if (op == "JMP")
-    {
-        std::string label;
-        iss >> label;
-        pc = labelMap[label] - 1;
-    }
-    else if (op == "JE")
-    {
-        std::string label;
-        iss >> label;
-        if (registers[0] == 0)
-            pc = labelMap[label] - 1;
-    }
-    else if (op == "JNE")
-    {
-        std::string label;
-        iss >> label;
-        if (registers[0] != 0)
-            pc = labelMap[label] - 1;
-    }
-    else if (op == "JLT")
-    {
-        std::string label;
-        iss >> label;
-        if (registers[0] < 0)
-            pc = labelMap[label] - 1;
-    }
-    else if (op == "JGT")
-    {
-        std::string label;
-        iss >> label;
-        if (registers[0] > 0)
-            pc = labelMap[label] - 1;
-    }
-    else if (op == "JLE")
+
+op_invalid:
+    std::copy(r, r + 8, registers);
+    pc = static_cast<int>(ip - base);
+    throw std::runtime_error("Unknown opcode: " + std::to_string(static_cast<int>(ip->opcode)));
+
+div_zero:
+    std::copy(r, r + 8, registers);
+    pc = static_cast<int>(ip - base);
+    throw std::runtime_error("Division by zero at pc " + std::to_string(pc));
+
+yield:
+    ION_UNUSED_LABEL
+    status = StepStatus::Yielded;
+
+done:
+    std::copy(r, r + 8, registers);
+    pc = static_cast<int>(ip - base);
+    if constexpr (Budgeted)
+        retired += static_cast<uint64_t>(static_cast<int64_t>(budget) - remaining);
+    output->flush();
+    return status;
+}
+
+#undef SET_IF_IMM
+#undef SET_IF
+#undef SET_COMPARE
+#undef SHIFT_ARITHMETIC
+#undef SHIFT_RIGHT
+#undef SHIFT_LEFT
+#undef DIVIDE
+#undef CHARGE_BUDGET
+#undef JUMP_IF
+#undef NEXT
+#undef PROFILE_TAKEN
+#undef PROFILE_HIT
+#undef DISPATCH
+#undef HANDLER
+
+void VirtualMachine::run()
+{
+#ifdef ION_COMPUTED_GOTO
+    if (profiler)
+        execute<true, true, false>(0);
+    else
+        execute<true, false, false>(0);
+#else
+    runSwitch();
+#endif
+}
+
+void VirtualMachine::runSwitch()
+{
+    if (profiler)
+        execute<false, true, false>(0);
+    else
+        execute<false, false, false>(0);
+}
+
+StepStatus VirtualMachine::step(uint64_t maxInstructions)
+{
+    if (!fault.empty())
+        return StepStatus::Faulted;
+
+    try
     {
-        std::string label;
-        iss >> label;
-        if (registers[0] <= 0)
-            pc = labelMap[label] - 1;
+#ifdef ION_COMPUTED_GOTO
+        constexpr bool threaded = true;
+#else
+        constexpr bool threaded = false;
+#endif
+        if (profiler)
+            return execute<threaded, true, true>(maxInstructions);
+        return execute<threaded, false, true>(maxInstructions);
     }
-    else if (op == "JGE")
+    catch (const std::exception &e)
     {
-        std::string label;
-        iss >> label;
-        if (registers[0] >= 0)
-            pc = labelMap[label] - 1;
+        fault = e.what();
+        running = false;
+        output->flush();
+        return StepStatus::Faulted;
     }
-    else if (op == "PRINT")
-    {
-        std::string reg;
-        iss >> reg;
+}
 
-        if (reg.length() != 2 || reg[0] != 'R' || !isdigit(reg[1]))
-            throw std::runtime_error("Invalid register format: " + reg);
+void VirtualMachine::setProfiling(bool enabled)
+{
+    if (!enabled)
+        profiler.reset();
+    else if (!profiler)
+        profiler = std::make_unique<Profiler>();
+}
 
-        int regIndex = reg[1] - '0';
-        if (regIndex < 0 || regIndex >= 8)
-            throw std::runtime_error("Register out of bounds: " + reg);
+void VirtualMachine::writeProfileReport(std::ostream &out) const
+{
+    if (profiler && program)
+        profiler->writeReport(out, program->code, program->labels);
+}
 
-        std::cout << registers[regIndex] << std::endl;
-    }
-    else if (op == "PRINTS")
-    {
-        std::string label;
-        iss >> label;
+void VirtualMachine::writeProfileJson(const std::string &filename) const
+{
+    if (profiler && program)
+        profiler->writeJson(filename, program->code, program->labels);
+}
 
-        if (stringData.find(label) == stringData.end())
-        {
-            throw std::runtime_error("Unknown string label: " + label);
-        }
+void VirtualMachine::jitPrintInt(void *context, int value)
+{
+    static_cast<VirtualMachine *>(context)->output->writeInt(value);
+}
 
-        std::cout << stringData[label] << std::endl;
-    }
-    else if (op == "HALT")
-    {
+void VirtualMachine::jitPrintString(void *context, int stringId)
+{
+    auto *vm = static_cast<VirtualMachine *>(context);
+    vm->output->writeLine(vm->program->strings[stringId]);
+}
+
+void VirtualMachine::runJit()
+{
+    if (!running || !program)
+        return;
+
+    JitCompiler jit(program->code, program->labels);
+
+    JitFrame frame;
+    std::copy(registers, registers + 8, frame.registers);
+    frame.pc = pc;
+    frame.halted = 0;
+    frame.memory = memory;
+    frame.divideByZero = 0;
+
+    JitCallbacks callbacks{&VirtualMachine::jitPrintInt, &VirtualMachine::jitPrintString, this};
+    jit.run(frame, callbacks);
+
+    std::copy(frame.registers, frame.registers + 8, registers);
+    pc = frame.pc;
+    if (frame.halted)
         running = false;
-    }
-    else if (op == "LABEL")
-    {
-        // do nothing — label already parsed
-    }
-    else
-    {
-        throw std::runtime_error("Unknown instruction: " + op);
-    }
+    output->flush();
+    if (frame.divideByZero)
+        throw std::runtime_error("Division by zero at pc " + std::to_string(pc));
 }
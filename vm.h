@@ -1,29 +1,89 @@
 #ifndef VM_H
 #define VM_H
 
+#include "image.h"
+#include "output.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include <memory>
 #include <string>
 #include <vector>
-#include <unordered_map>
+
+enum class StepStatus {
+    Yielded, // budget used up; call step() again to continue
+    Halted,  // HALT executed or ran off the end of the program
+    Faulted  // runtime error; see faultMessage()
+};
 
 class VirtualMachine {
 public:
     VirtualMachine();
-    void loadProgram(const std::vector<std::string>& program);
+    void loadProgram(const InstructionBuffer& program);
+    // Parses program.asm text first
+    void loadProgram(const std::vector<std::string>& assembly);
+    void loadBinary(const std::string& filename);
+    void loadBinary(const std::vector<uint8_t>& bytes);
+    // Shares an already decoded image; VM state (registers, memory, output) stays per instance
+    void load(std::shared_ptr<const ProgramImage> image);
+
+    // Runs with computed-goto dispatch where the compiler supports it
     void run();
+    // Runs with the portable switch dispatch loop
+    void runSwitch();
+    // Translates the program to x86-64 and runs it natively
+    void runJit();
+
+    // Runs at most about maxInstructions original instructions (a fused
+    // record may overrun by a few) and reports why it stopped. Errors are
+    // returned as Faulted instead of thrown.
+    StepStatus step(uint64_t maxInstructions);
+    // Instructions executed by step() since the program was loaded
+    uint64_t retiredInstructions() const { return retired; }
+    const std::string& faultMessage() const { return fault; }
+
+    // PRINT / PRINTS go to this sink (not owned); defaults to buffered stdout.
+    // The sink is flushed when the program halts or runs off its end.
+    void setOutput(OutputSink* sink);
+
+    // Profiling runs a separately instantiated dispatch loop that counts
+    // per-pc hits and taken branches; the normal loop carries no counters.
+    void setProfiling(bool enabled);
+    void writeProfileReport(std::ostream& out) const;
+    void writeProfileJson(const std::string& filename) const;
+
+    // Captures registers, memory, pc and running for the loaded program.
+    // restore() rejects snapshots taken from a different program.
+    VmSnapshot snapshot() const;
+    void restore(const VmSnapshot& state);
+    void saveSnapshot(const std::string& filename) const;
+    void loadSnapshot(const std::string& filename);
+
+    // Superinstruction fusion is applied at load time; on by default
+    void setFusion(bool enabled);
+    // Number of original (unfused) instructions in the loaded program
+    int instructionCount() const;
 
 private:
     int registers[8];
-    int memory[1024];
+    int memory[VM_MEMORY_SIZE];
     int pc;
     bool running;
+    uint64_t retired = 0;
+    std::string fault;
+
+    std::shared_ptr<const ProgramImage> program;
+    bool fusion = true;
+
+    std::unique_ptr<OutputSink> defaultOutput;
+    OutputSink* output;
+
+    std::unique_ptr<Profiler> profiler;
 
-    std::vector<std::string> instructions;
-    std::unordered_map<std::string, int> labelMap;
-    std::unordered_map<std::string, std::string> stringData;
+    template <bool Threaded, bool Profile, bool Budgeted>
+    StepStatus execute(uint64_t budget);
 
-    int getRegisterIndex(const std::string& reg);
-    void parseLabels();
-    void executeInstruction(const std::string& line);
+    static void jitPrintInt(void* context, int value);
+    static void jitPrintString(void* context, int stringId);
 };
 
 #endif